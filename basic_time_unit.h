@@ -0,0 +1,140 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Compact (8 byte) alternative to time_unit for storing large numbers of
+ * time instants/lengths.
+ *
+ * Where a time_unit carries both _cycles and a timespec and decides at run
+ * time (_use_cycles) which one is used, a basic_time_unit holds a single
+ * signed tick count and the clock (i.e., the unit of the ticks) is part of
+ * its type:
+ *
+ * 	basic_time_unit<tsc_clock> - ticks are TSC cycles
+ * 	basic_time_unit<ns_clock>  - ticks are nanoseconds (of time_unit's
+ * 	                             clock, CLOCK_MONOTONIC)
+ *
+ * Arithmetic and comparisons are constexpr and branch free.  Mixing clocks
+ * does not compile; converting between them requires an explicit
+ * time_cast<>() (which uses the cpu_hz conversion, see clock_params.h).
+ *
+ * Conversions to and from time_unit are provided by time_unit (see
+ * time_unit::to_basic()), so code using the time_unit API keeps working.
+ * A time_unit cannot be negative: converting a negative basic_time_unit to
+ * one exits.
+ *
+ * NOTE: like time_unit, a converted instant is only scaled, not re-anchored
+ * (i.e., a converted TSC instant is not a CLOCK_MONOTONIC instant).
+ */
+
+#include <ostream>
+
+#include "data_types.h"
+#include "clock_params.h"
+
+struct tsc_clock {
+	static const char *name(void) { return "cycles"; }
+};
+
+struct ns_clock {
+	static const char *name(void) { return "nsecs"; }
+};
+
+template <class ClockTag>
+class basic_time_unit {
+	public:
+		typedef ClockTag clock;
+
+		constexpr basic_time_unit(void) : _ticks(0) {}
+		constexpr explicit basic_time_unit(s64 ticks) : _ticks(ticks) {}
+
+		constexpr s64 ticks(void) const { return _ticks; }
+
+		static basic_time_unit NOW(void);
+
+		// arithmetic wraps (two's complement) rather than overflowing, also
+		// INT64_MIN / -1 (== INT64_MIN); dividing by 0 is still undefined
+		constexpr basic_time_unit operator+(basic_time_unit rhs) const
+		{ return basic_time_unit((s64)((u64)_ticks + (u64)rhs._ticks)); }
+
+		constexpr basic_time_unit operator-(basic_time_unit rhs) const
+		{ return basic_time_unit((s64)((u64)_ticks - (u64)rhs._ticks)); }
+
+		constexpr basic_time_unit operator-(void) const
+		{ return basic_time_unit((s64)(0 - (u64)_ticks)); }
+
+		constexpr basic_time_unit operator*(s64 multiplier) const
+		{ return basic_time_unit((s64)((u64)_ticks * (u64)multiplier)); }
+
+		constexpr basic_time_unit operator/(s64 divisor) const
+		{ return divisor == -1 ? -*this : basic_time_unit(_ticks / divisor); }
+
+		basic_time_unit &operator+=(basic_time_unit rhs) { return *this = *this + rhs; }
+		basic_time_unit &operator-=(basic_time_unit rhs) { return *this = *this - rhs; }
+
+		constexpr bool operator==(basic_time_unit rhs) const { return _ticks == rhs._ticks; }
+		constexpr bool operator!=(basic_time_unit rhs) const { return _ticks != rhs._ticks; }
+		constexpr bool operator<(basic_time_unit rhs) const { return _ticks < rhs._ticks; }
+		constexpr bool operator<=(basic_time_unit rhs) const { return _ticks <= rhs._ticks; }
+		constexpr bool operator>(basic_time_unit rhs) const { return _ticks > rhs._ticks; }
+		constexpr bool operator>=(basic_time_unit rhs) const { return _ticks >= rhs._ticks; }
+
+	private:
+		s64 _ticks;
+};
+
+static_assert(sizeof(basic_time_unit<tsc_clock>) == 8, "basic_time_unit must stay 8 bytes");
+static_assert(sizeof(basic_time_unit<ns_clock>) == 8, "basic_time_unit must stay 8 bytes");
+
+typedef basic_time_unit<tsc_clock> tsc_time_unit;
+typedef basic_time_unit<ns_clock> ns_time_unit;
+
+// defined in time_unit.cpp
+template <> tsc_time_unit tsc_time_unit::NOW(void);
+template <> ns_time_unit ns_time_unit::NOW(void);
+
+/**
+ * Explicit conversion between clocks.
+ */
+template <class ToTag, class FromTag>
+struct time_caster;
+
+template <class Tag>
+struct time_caster<Tag, Tag> {
+	static basic_time_unit<Tag> cast(basic_time_unit<Tag> t) { return t; }
+};
+
+template <>
+struct time_caster<ns_clock, tsc_clock> {
+	static ns_time_unit cast(tsc_time_unit t)
+	{
+		return t.ticks() >= 0
+			? ns_time_unit((s64)clock_params::cycles2nsec((u64)t.ticks()))
+			: -ns_time_unit((s64)clock_params::cycles2nsec((u64)(-t).ticks()));
+	}
+};
+
+template <>
+struct time_caster<tsc_clock, ns_clock> {
+	static tsc_time_unit cast(ns_time_unit t)
+	{
+		return t.ticks() >= 0
+			? tsc_time_unit((s64)clock_params::nsec2cycles((u64)t.ticks()))
+			: -tsc_time_unit((s64)clock_params::nsec2cycles((u64)(-t).ticks()));
+	}
+};
+
+template <class ToTag, class FromTag>
+inline
+basic_time_unit<ToTag> time_cast(basic_time_unit<FromTag> t)
+{
+	return time_caster<ToTag, FromTag>::cast(t);
+}
+
+template <class ClockTag>
+inline
+std::ostream& operator<<(std::ostream &out, basic_time_unit<ClockTag> t)
+{
+	return out << ClockTag::name() << "(" << t.ticks() << ")";
+}
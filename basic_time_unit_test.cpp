@@ -0,0 +1,162 @@
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <limits>
+using namespace std;
+
+#include "time_unit.h"
+#include "basic_time_unit.h"
+
+/**
+ * DESCRIPTION:
+ * Checks of basic_time_unit (see basic_time_unit.h):
+ *
+ * 	- wrapping arithmetic at the ends of the s64 range, including
+ * 	  INT64_MIN / -1 (also at compile time, the operators are constexpr)
+ * 	- time_cast<>() between cycles and nsecs, for both signs
+ * 	- conversions to and from time_unit, for both clocks
+ * 	- converting a negative one to a time_unit exits
+ *
+ * usage: basic_time_unit_test
+ */
+
+static const s64 s64_min = numeric_limits<s64>::min();
+static const s64 s64_max = numeric_limits<s64>::max();
+
+static_assert((ns_time_unit(s64_max) + ns_time_unit(1)).ticks() == s64_min, "+ wraps");
+static_assert((ns_time_unit(s64_min) - ns_time_unit(1)).ticks() == s64_max, "- wraps");
+static_assert((-ns_time_unit(s64_min)).ticks() == s64_min, "negation wraps");
+static_assert((ns_time_unit(s64_min) / -1).ticks() == s64_min, "INT64_MIN / -1 wraps");
+static_assert((ns_time_unit(-7) / 2).ticks() == -3, "/ truncates toward 0");
+
+static bool
+check(const char *what, bool ok)
+{
+	printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static bool
+arithmetic(void)
+{
+	bool ok = true;
+
+	// not constant folded: @one is only known at run time
+	volatile s64 one = 1;
+	tsc_time_unit max(s64_max), min(s64_min);
+
+	ok &= check("max + 1 == min", max + tsc_time_unit(one) == min);
+	ok &= check("min - 1 == max", min - tsc_time_unit(one) == max);
+	ok &= check("-min == min", -min == min);
+	ok &= check("min / -1 == min", min / -one == min);
+	ok &= check("max * 2 == -2", max * (2 * one) == tsc_time_unit(-2));
+
+	tsc_time_unit t(s64_max - 5);
+	t += tsc_time_unit(10 * one);
+	ok &= check("+= wraps", t == tsc_time_unit(s64_min + 4));
+	t -= tsc_time_unit(10 * one);
+	ok &= check("-= wraps back", t == tsc_time_unit(s64_max - 5));
+
+	return ok;
+}
+
+static bool
+casts(void)
+{
+	bool ok = true;
+	bool symmetric = true, round_trip = true, matches = true;
+
+	// up to about 3 years either way
+	for (s64 ns=1; ns<((s64)1 << 56); ns=ns * 3 + 1) {
+		tsc_time_unit c = time_cast<tsc_clock>(ns_time_unit(ns));
+
+		symmetric &= time_cast<tsc_clock>(ns_time_unit(-ns)) == -c;
+		matches &= (u64)c.ticks() == clock_params::nsec2cycles((u64)ns);
+
+		// the fixed-point conversions may each lose a nsec
+		s64 back = time_cast<ns_clock>(c).ticks();
+		round_trip &= back >= ns - 2 && back <= ns + 2;
+		back = time_cast<ns_clock>(-c).ticks();
+		round_trip &= back >= -ns - 2 && back <= -ns + 2;
+	}
+
+	ok &= check("time_cast<tsc_clock>() == nsec2cycles()", matches);
+	ok &= check("time_cast<>() of -t == -time_cast<>() of t", symmetric);
+	ok &= check("nsecs -> cycles -> nsecs", round_trip);
+	ok &= check("time_cast<>() of 0", time_cast<ns_clock>(tsc_time_unit()) == ns_time_unit() &&
+		time_cast<tsc_clock>(ns_time_unit()) == tsc_time_unit());
+	ok &= check("time_cast<>() to the same clock", time_cast<ns_clock>(ns_time_unit(s64_min)) ==
+		ns_time_unit(s64_min));
+
+	return ok;
+}
+
+static bool
+time_unit_conversions(void)
+{
+	bool ok = true;
+	bool same = true;
+
+	for (s64 ticks : { (s64)0, (s64)1, (s64)999999999, (s64)1000000000, (s64)1 << 40, s64_max }) {
+		same &= time_unit(tsc_time_unit(ticks)).to_basic<tsc_clock>() == tsc_time_unit(ticks);
+		same &= time_unit(ns_time_unit(ticks)).to_basic<ns_clock>() == ns_time_unit(ticks);
+	}
+	ok &= check("time_unit round trip (both clocks)", same);
+
+	time_unit secs = time_unit::SECS(3, false);
+	ok &= check("time_unit::to_basic<ns_clock>()", secs.to_basic<ns_clock>() ==
+		ns_time_unit(3000000000LL));
+	ok &= check("time_unit::to_basic<tsc_clock>() (nsecs)", secs.to_basic<tsc_clock>() ==
+		time_cast<tsc_clock>(ns_time_unit(3000000000LL)));
+
+	return ok;
+}
+
+// @convert has to exit(EXIT_FAILURE), in a child process
+template <class F>
+static bool
+exits(F convert)
+{
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (!pid) {
+		// its message is not part of the output
+		if (!freopen("/dev/null", "w", stdout))
+			_exit(EXIT_SUCCESS);
+		convert();
+		_exit(EXIT_SUCCESS);
+	}
+
+	int status;
+	return pid > 0 && waitpid(pid, &status, 0) == pid &&
+		WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+static bool
+negative(void)
+{
+	bool ok = true;
+
+	ok &= check("negative ns_time_unit -> time_unit exits",
+		exits([] { time_unit t{ns_time_unit(-1)}; (void)t; }));
+	ok &= check("negative tsc_time_unit -> time_unit exits",
+		exits([] { time_unit t{tsc_time_unit(s64_min)}; (void)t; }));
+
+	return ok;
+}
+
+int main(void)
+{
+	// the casts need cpu_hz
+	time_unit init(true);
+
+	bool ok = arithmetic();
+	ok &= casts();
+	ok &= time_unit_conversions();
+	ok &= negative();
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Helpers shared by the benchmarks: the latency and cpu usage columns of
+ * their reports (the cpu time itself is measured with cpu_time.h).
+ */
+
+#include <cstdio>
+
+#include "data_types.h"
+#include "cpu_time.h"
+#include "preempt_histogram.h"
+
+static const double bench_percentiles[] = { 50, 90, 99, 99.9 };
+
+// " p50 ... max ..." of @latency (nsecs), in usecs
+static inline void
+print_latency_usecs(const preempt_histogram &latency)
+{
+	for (double p : bench_percentiles)
+		printf(" p%-4g %8.1f", p, (double)latency.percentile(p) / 1E3);
+	printf(" max %8.1f", (double)latency.max() / 1E3);
+}
+
+// share of a cpu @cpu_ns of @wall_ns is, and usecs per each of @nr @what
+static inline void
+print_cpu_usage(u64 cpu_ns, u64 wall_ns, u64 nr, const char *what)
+{
+	printf("  | cpu %6.2f%% of a cpu, %6.2f usecs/%s",
+		wall_ns ? 100.0 * (double)cpu_ns / (double)wall_ns : 0,
+		nr ? (double)cpu_ns / 1E3 / (double)nr : 0, what);
+}
@@ -0,0 +1,219 @@
+#include <unistd.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "clock_params.h"
+#include "calibration_cache.h"
+
+static_assert(sizeof(calibration_cache::record) == 184, "calibration_cache::record layout changed, bump VERSION");
+
+string calibration_cache::_path;
+
+void
+calibration_cache::set_path(const string &path)
+{
+	_path = path;
+}
+
+string
+calibration_cache::path()
+{
+	if (!_path.empty())
+		return _path;
+
+	const char *env = getenv("TIME_UNIT_CALIBRATION_CACHE");
+	if (env && *env)
+		return env;
+
+	const char *home_dir = getenv("HOME");
+	if (home_dir && *home_dir)
+		return string(home_dir) + "/.cpu_hz.cache";
+
+	return "/tmp/.cpu_hz.cache";
+}
+
+/**
+ * cpuid signature (family/model/stepping) and brand string, or /proc/cpuinfo
+ * "model name" if cpuid is not available.
+ */
+string
+calibration_cache::cpu_model()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned regs[12];
+	unsigned eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+			&& __get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+		char signature[16];
+		snprintf(signature, sizeof(signature), "%08x ", eax);
+
+		for (unsigned i=0; i<3; ++i)
+			__get_cpuid(0x80000002 + i, &regs[i*4], &regs[i*4+1], &regs[i*4+2], &regs[i*4+3]);
+
+		char brand[sizeof(regs) + 1];
+		memcpy(brand, regs, sizeof(regs));
+		brand[sizeof(regs)] = '\0';
+
+		return string(signature) + brand;
+	}
+#endif
+
+	ifstream istm("/proc/cpuinfo");
+	string line;
+	while (getline(istm, line)) {
+		if (0 == line.compare(0, 10, "model name"))
+			return line.substr(line.find(':') + 2);
+	}
+
+	return "";
+}
+
+string
+calibration_cache::boot_id()
+{
+	ifstream istm("/proc/sys/kernel/random/boot_id");
+	string id;
+
+	istm >> id;
+
+	return id;
+}
+
+/**
+ * FNV-1a
+ */
+static u64
+checksum(const calibration_cache::record &rec)
+{
+	const unsigned char *p = (const unsigned char *)&rec;
+	u64 hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i=0; i<offsetof(calibration_cache::record, checksum); ++i) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static void
+copy_str(char *dst, size_t dst_size, const string &src)
+{
+	memset(dst, 0, dst_size);
+	strncpy(dst, src.c_str(), dst_size - 1);
+}
+
+static bool
+str_equal(const char *rec_str, size_t rec_size, const string &str)
+{
+	return 0 == strncmp(rec_str, str.c_str(), rec_size - 1) && str.size() < rec_size;
+}
+
+/**
+ * @return - true if @cal was filled from a valid cache record
+ */
+bool
+calibration_cache::load(tsc_calibration &cal)
+{
+	record rec;
+	string file_name = path();
+
+	int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	ssize_t bytes = read(fd, &rec, sizeof(rec));
+	close(fd);
+
+	if (bytes != (ssize_t)sizeof(rec)
+			|| rec.magic != MAGIC
+			|| rec.version != VERSION
+			|| rec.size != sizeof(rec)
+			|| rec.checksum != checksum(rec)) {
+		cout << file_name << " is not a valid calibration cache, ignoring." << endl;
+		return false;
+	}
+
+	if (!str_equal(rec.boot_id, sizeof(rec.boot_id), boot_id())
+			|| !str_equal(rec.cpu_model, sizeof(rec.cpu_model), cpu_model())) {
+		cout << file_name << " is from a different boot or cpu, ignoring." << endl;
+		return false;
+	}
+
+	// guards against changes to the fixed-point conversions
+	mult_shift cyc2ns, ns2cyc;
+	clock_params::calc(rec.hz, cyc2ns, ns2cyc);
+	if (cyc2ns.mult != rec.cyc2ns_mult || cyc2ns.shift != rec.cyc2ns_shift
+			|| ns2cyc.mult != rec.ns2cyc_mult || ns2cyc.shift != rec.ns2cyc_shift) {
+		cout << file_name << " has stale mult/shift values, ignoring." << endl;
+		return false;
+	}
+
+	cal.hz = rec.hz;
+	cal.error_ppm = rec.error_ppm;
+	cal.source = (tsc_calibration::source_t)rec.source;
+
+	return true;
+}
+
+/**
+ * Atomically (write + rename) replace the cache with @cal.
+ */
+bool
+calibration_cache::store(const tsc_calibration &cal)
+{
+	record rec;
+	memset(&rec, 0, sizeof(rec));
+
+	mult_shift cyc2ns, ns2cyc;
+	clock_params::calc(cal.hz, cyc2ns, ns2cyc);
+
+	rec.magic = MAGIC;
+	rec.version = VERSION;
+	rec.size = sizeof(rec);
+	rec.source = cal.source;
+	rec.hz = cal.hz;
+	rec.error_ppm = cal.error_ppm;
+	rec.cyc2ns_mult = cyc2ns.mult;
+	rec.ns2cyc_mult = ns2cyc.mult;
+	rec.cyc2ns_shift = cyc2ns.shift;
+	rec.ns2cyc_shift = ns2cyc.shift;
+	copy_str(rec.cpu_model, sizeof(rec.cpu_model), cpu_model());
+	copy_str(rec.boot_id, sizeof(rec.boot_id), boot_id());
+	rec.checksum = checksum(rec);
+
+	string file_name = path();
+	stringstream tmp_name;
+	tmp_name << file_name << ".tmp." << getpid();
+
+	int fd = open(tmp_name.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		cout << "unable to create " << tmp_name.str() << endl;
+		return false;
+	}
+
+	bool ok = write(fd, &rec, sizeof(rec)) == (ssize_t)sizeof(rec);
+	ok = (0 == close(fd)) && ok;
+	ok = ok && (0 == rename(tmp_name.str().c_str(), file_name.c_str()));
+
+	if (!ok) {
+		cout << "unable to write " << file_name << endl;
+		unlink(tmp_name.str().c_str());
+	}
+
+	return ok;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Binary cache of a TSC calibration, so that processes do not each pay the
+ * calibration cost.
+ *
+ * Besides the calibration (hz, mult/shift pairs, error estimate) a record
+ * stores the cpu model and the boot id it was made on.  A record is only
+ * used if it has the expected magic/version/checksum, its mult/shift pairs
+ * match the ones computed from its hz, and it was made on the same cpu model
+ * during the current boot.  Otherwise it is ignored (and overwritten by the
+ * next store()).
+ *
+ * The file location is (first match):
+ *
+ * 	- set_path()
+ * 	- $TIME_UNIT_CALIBRATION_CACHE
+ * 	- $HOME/.cpu_hz.cache
+ * 	- /tmp/.cpu_hz.cache
+ *
+ * Since the boot id is the same for all containers on a host, several
+ * containers can share one calibration by pointing at the same file.
+ */
+
+#include <string>
+
+#include "data_types.h"
+#include "tsc_calibration.h"
+
+class calibration_cache {
+	public:
+		static const u32 MAGIC = 0x5453434b; // "TSCK"
+		static const u32 VERSION = 1;
+
+		struct record {
+			u32 magic;
+			u32 version;
+			u32 size; // sizeof(record)
+			u32 source; // tsc_calibration::source_t
+			double hz;
+			double error_ppm;
+			u64 cyc2ns_mult;
+			u64 ns2cyc_mult;
+			u32 cyc2ns_shift;
+			u32 ns2cyc_shift;
+			char cpu_model[80];
+			char boot_id[40];
+			u64 checksum; // of all of the above
+		};
+
+		static void set_path(const std::string &path);
+		static std::string path(void);
+
+		static bool load(tsc_calibration &cal);
+		static bool store(const tsc_calibration &cal);
+
+		// identification of the current host
+		static std::string cpu_model(void);
+		static std::string boot_id(void);
+
+	private:
+		calibration_cache();
+
+		static std::string _path;
+};
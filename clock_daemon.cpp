@@ -0,0 +1,69 @@
+#include <unistd.h>
+#include <csignal>
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "time_unit.h"
+#include "clock_page.h"
+
+/**
+ * DESCRIPTION:
+ * Calibrates the TSC once and publishes a clock page (see clock_page.h) that
+ * other processes on this host can use instead of calibrating themselves.
+ *
+ * Readers attach with time_unit::attach_clock_page(), or automatically (on
+ * the first cycles time_unit) if TIME_UNIT_CLOCK_PAGE is set to the path.
+ *
+ * usage: clock_daemon [path] [update interval (msecs)]
+ */
+
+volatile sig_atomic_t done = 0;
+
+void SIG_handler(int)
+{
+	done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	string path = clock_page::default_path();
+	u64 interval_ms = 1000;
+
+	if (argc > 1)
+		path = argv[1];
+	if (argc > 2)
+		interval_ms = strtoull(argv[2], NULL, 10);
+
+	struct sigaction sa;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sa.sa_handler = SIG_handler;
+	sigaction(SIGTERM, &sa, 0);
+	sigaction(SIGINT, &sa, 0);  // ctrl-c
+
+	// calibrates cpu_hz (or takes it from .cpu_hz/the calibration cache)
+	time_unit init(true);
+
+	clock_page::data *page = clock_page::create(path, interval_ms * (u64)1E6);
+	if (!page)
+		return EXIT_FAILURE;
+
+	cout << "publishing clock page " << path << " every " << interval_ms << " msecs" << endl;
+
+	time_unit next = time_unit::NOW(false);
+	while (!done) {
+		clock_page::update(page, time_unit::cpu_hz());
+
+		next.add_ns(interval_ms * (u64)1E6);
+		next.sleep_absolute(false);
+	}
+
+	// processes still attached fall back to clock_gettime() a few intervals later
+	unlink(path.c_str());
+
+	return EXIT_SUCCESS;
+}
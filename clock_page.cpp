@@ -0,0 +1,194 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "x86_tsc.h"
+#include "gcc_helpers/debug.h"
+
+#include "clock_page.h"
+
+constexpr size_t page_size = 4096;
+static_assert(sizeof(clock_page::data) <= page_size, "clock_page::data must fit in one page");
+
+// a difference from CLOCK_MONOTONIC larger than this is stepped, not slewed
+constexpr s64 max_slew_ns = (s64)1E6;
+
+static u64
+ts2ns(const struct timespec &ts)
+{
+	return (u64)ts.tv_sec * (u64)1E9 + (u64)ts.tv_nsec;
+}
+
+/**
+ * Read the TSC, CLOCK_MONOTONIC and CLOCK_REALTIME as close together as
+ * possible (best of a few tries, TSC taken at the middle of the window).
+ */
+static void
+sample_clocks(u64 &tsc, u64 &mono, u64 &real)
+{
+	u64 best_window = ~0ULL;
+	tsc = mono = real = 0;
+
+	for (int i=0; i<4; ++i) {
+		struct timespec ts_mono, ts_real;
+		u64 before = read_tsc<tsc_read::lfence>();
+		CHECK(clock_gettime(CLOCK_MONOTONIC, &ts_mono));
+		CHECK(clock_gettime(CLOCK_REALTIME, &ts_real));
+		u64 after = read_tsc<tsc_read::lfence>();
+
+		if (after - before < best_window) {
+			best_window = after - before;
+			tsc = before + best_window / 2;
+			mono = ts2ns(ts_mono);
+			real = ts2ns(ts_real);
+		}
+	}
+}
+
+string
+clock_page::default_path()
+{
+	const char *env = getenv("TIME_UNIT_CLOCK_PAGE");
+	if (env && *env)
+		return env;
+
+	return "/dev/shm/time_unit_clock";
+}
+
+clock_page::data *
+clock_page::create(const string &path, u64 update_interval_ns)
+{
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		cout << "unable to create " << path << endl;
+		return nullptr;
+	}
+
+	if (ftruncate(fd, page_size)) {
+		cout << "unable to size " << path << endl;
+		close(fd);
+		return nullptr;
+	}
+
+	void *addr = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == addr) {
+		cout << "unable to map " << path << endl;
+		return nullptr;
+	}
+
+	data *page = (data *)addr;
+
+	// invalidate while (re)initializing, readers check magic after mapping
+	page->magic = 0;
+	page->seq.store(0, memory_order_relaxed);
+	page->hz.store(0, memory_order_relaxed);
+	page->update_interval_ns.store(update_interval_ns, memory_order_relaxed);
+	page->version = VERSION;
+	atomic_thread_fence(memory_order_release);
+	page->magic = MAGIC;
+
+	return page;
+}
+
+/**
+ * Publish a new anchor (and @hz).  Called every update_interval_ns by the
+ * publisher.
+ */
+void
+clock_page::update(data *page, double hz)
+{
+	u64 tsc, mono, real;
+	sample_clocks(tsc, mono, real);
+
+	u64 interval_ns = page->update_interval_ns.load(memory_order_relaxed);
+	u64 int_hz = (u64)(hz + 0.5);
+	u64 mono_base = mono;
+	mult_shift cyc2ns;
+
+	if (0 == page->hz.load(memory_order_relaxed)) {
+		cyc2ns = mult_shift::calc(int_hz, (u64)1E9);
+	} else {
+		// continue from where the page's time is now ...
+		u64 page_now = mono_ns(page, tsc);
+		s64 err = (s64)(mono - page_now);
+
+		if (err > max_slew_ns || err < -max_slew_ns) {
+			cyc2ns = mult_shift::calc(int_hz, (u64)1E9);
+		} else {
+			// ... and run slightly fast/slow so that the difference to
+			// CLOCK_MONOTONIC is gone by the next update
+			s64 correction = err * (s64)1E9 / (s64)interval_ns;
+			cyc2ns = mult_shift::calc(int_hz, (u64)((s64)1E9 + correction));
+			mono_base = page_now;
+		}
+	}
+
+	u32 seq = page->seq.load(memory_order_relaxed);
+	page->seq.store(seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	page->hz.store(hz, memory_order_relaxed);
+	page->mult.store(cyc2ns.mult, memory_order_relaxed);
+	page->shift.store(cyc2ns.shift, memory_order_relaxed);
+	page->cyc_base.store(tsc, memory_order_relaxed);
+	page->mono_base.store(mono_base, memory_order_relaxed);
+	page->real_offset.store((s64)(real - mono), memory_order_relaxed);
+	page->last_update_ns.store(mono, memory_order_relaxed);
+
+	page->seq.store(seq + 2, memory_order_release);
+}
+
+const clock_page::data *
+clock_page::attach(const string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(data)) {
+		cout << path << " is not a clock page, ignoring." << endl;
+		close(fd);
+		return nullptr;
+	}
+
+	void *addr = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == addr) {
+		cout << "unable to map " << path << endl;
+		return nullptr;
+	}
+
+	const data *page = (const data *)addr;
+	atomic_thread_fence(memory_order_acquire);
+
+	if (page->magic != MAGIC || page->version != VERSION
+			|| 0 == page->hz.load(memory_order_acquire) || is_stale(page)) {
+		cout << path << " is not a valid (or current) clock page, ignoring." << endl;
+		munmap(addr, page_size);
+		return nullptr;
+	}
+
+	return page;
+}
+
+bool
+clock_page::is_stale(const data *page)
+{
+	struct timespec now;
+	CHECK(clock_gettime(CLOCK_MONOTONIC, &now));
+
+	u64 last = page->last_update_ns.load(memory_order_relaxed);
+	u64 interval = page->update_interval_ns.load(memory_order_relaxed);
+
+	return ts2ns(now) - last > STALE_UPDATES * interval;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Clock parameters shared between processes through a memory mapped file,
+ * similar to the kernel's vDSO data page.
+ *
+ * One process (see clock_daemon.cpp) calibrates the TSC and periodically
+ * publishes (seqlock protected):
+ *
+ * 	- the TSC frequency and a cycles -> nsecs mult/shift
+ * 	- an anchor: a TSC value and the CLOCK_MONOTONIC time it corresponds to
+ * 	- the offset of CLOCK_REALTIME from CLOCK_MONOTONIC
+ *
+ * Any number of processes map the file read-only and turn a TSC read into
+ * CLOCK_MONOTONIC or CLOCK_REALTIME nanoseconds without a system call and
+ * without calibrating the TSC themselves.
+ *
+ * Rather than stepping the anchor to CLOCK_MONOTONIC on every update, the
+ * publisher adjusts mult so that the page converges to CLOCK_MONOTONIC by the
+ * next update.  That keeps the page's time continuous and monotonic while
+ * following NTP adjustments of CLOCK_MONOTONIC.
+ */
+
+#include <atomic>
+#include <string>
+
+#include "data_types.h"
+#include "mult_shift.h"
+
+class clock_page {
+	public:
+		static const u32 MAGIC = 0x54434c4b; // "TCLK"
+		static const u32 VERSION = 1;
+
+		// the mapped file
+		struct data {
+			u32 magic;
+			u32 version;
+			std::atomic<u32> seq;
+			u32 pad;
+			std::atomic<double> hz;
+			std::atomic<u64> mult;
+			std::atomic<u64> shift;
+			std::atomic<u64> cyc_base;
+			std::atomic<u64> mono_base;
+			std::atomic<s64> real_offset; // CLOCK_REALTIME - CLOCK_MONOTONIC
+			std::atomic<u64> update_interval_ns;
+			std::atomic<u64> last_update_ns; // CLOCK_MONOTONIC of the last update
+		};
+
+		struct snapshot {
+			double hz;
+			mult_shift cyc2ns;
+			u64 cyc_base;
+			u64 mono_base;
+			s64 real_offset;
+			u64 update_interval_ns;
+		};
+
+		static std::string default_path(void);
+
+		// publisher side
+		static data *create(const std::string &path, u64 update_interval_ns);
+		static void update(data *page, double hz);
+
+		// reader side
+		static const data *attach(const std::string &path);
+		static void read(const data *page, snapshot &snap);
+		static u64 mono_ns(const data *page, u64 tsc);
+		static u64 real_ns(const data *page, u64 tsc);
+
+		// as above, false (@ns unset) once the publisher missed a few updates
+		static bool current_mono_ns(const data *page, u64 tsc, u64 &ns);
+		static bool current_real_ns(const data *page, u64 tsc, u64 &ns);
+
+		// true if the publisher has missed a few updates (e.g., has exited)
+		static bool is_stale(const data *page);
+
+		// missed updates after which the publisher is considered gone
+		static const u64 STALE_UPDATES = 4;
+
+	private:
+		clock_page();
+
+		static u64 to_mono_ns(const snapshot &snap, u64 tsc);
+		static bool is_current(const snapshot &snap, u64 tsc);
+};
+
+/**
+ * inline functions (must be put in header)
+ * https://isocpp.org/wiki/faq/inline-functions
+ */
+
+inline
+void clock_page::read(const data *page, snapshot &snap)
+{
+	u32 seq;
+
+	do {
+		seq = page->seq.load(std::memory_order_acquire);
+
+		snap.hz = page->hz.load(std::memory_order_relaxed);
+		snap.cyc2ns.mult = page->mult.load(std::memory_order_relaxed);
+		snap.cyc2ns.shift = (u32)page->shift.load(std::memory_order_relaxed);
+		snap.cyc_base = page->cyc_base.load(std::memory_order_relaxed);
+		snap.mono_base = page->mono_base.load(std::memory_order_relaxed);
+		snap.real_offset = page->real_offset.load(std::memory_order_relaxed);
+		snap.update_interval_ns = page->update_interval_ns.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || seq != page->seq.load(std::memory_order_relaxed));
+}
+
+inline
+u64 clock_page::to_mono_ns(const snapshot &snap, u64 tsc)
+{
+	// tsc may have been read just before an update moved cyc_base past it
+	if (tsc >= snap.cyc_base)
+		return snap.mono_base + snap.cyc2ns.convert(tsc - snap.cyc_base);
+	else
+		return snap.mono_base - snap.cyc2ns.convert(snap.cyc_base - tsc);
+}
+
+/**
+ * Staleness from the TSC alone (the anchor is the TSC of the last update), so
+ * that readers check it on every read without a clock_gettime().
+ */
+inline
+bool clock_page::is_current(const snapshot &snap, u64 tsc)
+{
+	if (tsc <= snap.cyc_base)
+		return true;
+
+	return snap.cyc2ns.convert(tsc - snap.cyc_base) <= STALE_UPDATES * snap.update_interval_ns;
+}
+
+inline
+u64 clock_page::mono_ns(const data *page, u64 tsc)
+{
+	snapshot snap;
+	read(page, snap);
+
+	return to_mono_ns(snap, tsc);
+}
+
+inline
+u64 clock_page::real_ns(const data *page, u64 tsc)
+{
+	snapshot snap;
+	read(page, snap);
+
+	return to_mono_ns(snap, tsc) + (u64)snap.real_offset;
+}
+
+inline
+bool clock_page::current_mono_ns(const data *page, u64 tsc, u64 &ns)
+{
+	snapshot snap;
+	read(page, snap);
+
+	if (!is_current(snap, tsc))
+		return false;
+
+	ns = to_mono_ns(snap, tsc);
+	return true;
+}
+
+inline
+bool clock_page::current_real_ns(const data *page, u64 tsc, u64 &ns)
+{
+	snapshot snap;
+	read(page, snap);
+
+	if (!is_current(snap, tsc))
+		return false;
+
+	ns = to_mono_ns(snap, tsc) + (u64)snap.real_offset;
+	return true;
+}
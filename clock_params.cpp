@@ -0,0 +1,60 @@
+#include <mutex>
+using namespace std;
+
+#include <boost/numeric/conversion/cast.hpp>
+using boost::numeric_cast;
+
+#include "x86_tsc.h"
+
+#include "clock_params.h"
+
+clock_params::seq_data clock_params::_data;
+
+// only serializes writers, readers never take it
+static mutex write_lock;
+
+/**
+ * NOTE: the conversions use @hz rounded to an integer.  A fractional Hz is
+ * well below the accuracy of any calibration done here.
+ */
+void
+clock_params::calc(double hz, mult_shift &cyc2ns, mult_shift &ns2cyc)
+{
+	u64 int_hz = numeric_cast<u64>(hz + 0.5);
+
+	cyc2ns = mult_shift::calc(int_hz, (u64)1E9);
+	ns2cyc = mult_shift::calc((u64)1E9, int_hz);
+}
+
+/**
+ * Publish a new cpu frequency (initial calibration or recalibration).
+ */
+void
+clock_params::set_hz(double new_hz)
+{
+	mult_shift cyc2ns, ns2cyc;
+	calc(new_hz, cyc2ns, ns2cyc);
+
+	lock_guard<mutex> guard(write_lock);
+
+	// keep tsc2ns() continuous across the change of frequency
+	u64 cyc_base = 0;
+	u64 ns_base = 0;
+	if (is_set()) {
+		cyc_base = read_tsc();
+		ns_base = tsc2ns(cyc_base);
+	}
+
+	u32 seq = _data.seq.load(memory_order_relaxed);
+	_data.seq.store(seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	_data.cyc2ns_mult.store(cyc2ns.mult, memory_order_relaxed);
+	_data.ns2cyc_mult.store(ns2cyc.mult, memory_order_relaxed);
+	_data.shifts.store((u64)cyc2ns.shift | ((u64)ns2cyc.shift << 32), memory_order_relaxed);
+	_data.cyc_base.store(cyc_base, memory_order_relaxed);
+	_data.ns_base.store(ns_base, memory_order_relaxed);
+	_data.hz.store(new_hz, memory_order_release);
+
+	_data.seq.store(seq + 2, memory_order_release);
+}
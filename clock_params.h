@@ -0,0 +1,154 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Process wide parameters used to convert TSC cycles into nanoseconds.
+ *
+ * The parameters are published through a seqlock so that they can be
+ * recalibrated at runtime while other threads are converting.  Readers never
+ * block and never take a lock; they only retry in the (rare) case that a
+ * recalibration happened while they were reading.  On x86 the read side is
+ * plain loads, so it is cheap enough for hot loops.
+ *
+ * Besides the mult/shift pairs, the parameters include an offset
+ * (cyc_base, ns_base) that keeps tsc2ns() continuous across recalibrations:
+ *
+ * 	ns = ns_base + cycles2nsec(tsc - cyc_base)
+ */
+
+#include <atomic>
+
+#include "data_types.h"
+#include "mult_shift.h"
+
+class clock_params {
+	public:
+		struct snapshot {
+			double hz;
+			mult_shift cyc2ns;
+			mult_shift ns2cyc;
+			u64 cyc_base;
+			u64 ns_base;
+		};
+
+		// true once the parameters have been set at least once
+		static bool is_set(void);
+
+		// writer side, may be called at any time (writers are serialized)
+		static void set_hz(double hz);
+
+		// conversions that set_hz() publishes for @hz
+		static void calc(double hz, mult_shift &cyc2ns, mult_shift &ns2cyc);
+
+		// reader side
+		static double hz(void);
+		static void read(snapshot &snap);
+		static u64 cycles2nsec(u64 cycles);
+		static u64 nsec2cycles(u64 nsecs);
+		static u64 tsc2ns(u64 tsc);
+
+	private:
+		clock_params();
+
+		static u64 convert(u64 val, const std::atomic<u64> &mult, u32 shift_pos);
+
+		struct alignas(64) seq_data {
+			std::atomic<u32> seq;
+			std::atomic<double> hz;
+			std::atomic<u64> cyc2ns_mult;
+			std::atomic<u64> ns2cyc_mult;
+			// cyc2ns shift in the low 32 bits, ns2cyc shift in the high 32 bits
+			std::atomic<u64> shifts;
+			std::atomic<u64> cyc_base;
+			std::atomic<u64> ns_base;
+		};
+
+		static seq_data _data;
+};
+
+/**
+ * inline functions (must be put in header)
+ * https://isocpp.org/wiki/faq/inline-functions
+ */
+
+inline
+bool clock_params::is_set()
+{
+	return 0 != _data.hz.load(std::memory_order_acquire);
+}
+
+inline
+double clock_params::hz()
+{
+	return _data.hz.load(std::memory_order_acquire);
+}
+
+/**
+ * Consistent copy of all of the parameters.
+ */
+inline
+void clock_params::read(snapshot &snap)
+{
+	u32 seq;
+	u64 shifts;
+
+	do {
+		seq = _data.seq.load(std::memory_order_acquire);
+
+		snap.hz = _data.hz.load(std::memory_order_relaxed);
+		snap.cyc2ns.mult = _data.cyc2ns_mult.load(std::memory_order_relaxed);
+		snap.ns2cyc.mult = _data.ns2cyc_mult.load(std::memory_order_relaxed);
+		shifts = _data.shifts.load(std::memory_order_relaxed);
+		snap.cyc_base = _data.cyc_base.load(std::memory_order_relaxed);
+		snap.ns_base = _data.ns_base.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || seq != _data.seq.load(std::memory_order_relaxed));
+
+	snap.cyc2ns.shift = (u32)shifts;
+	snap.ns2cyc.shift = (u32)(shifts >> 32);
+}
+
+inline
+u64 clock_params::convert(u64 val, const std::atomic<u64> &mult, u32 shift_pos)
+{
+	u32 seq;
+	mult_shift ms;
+
+	do {
+		seq = _data.seq.load(std::memory_order_acquire);
+
+		ms.mult = mult.load(std::memory_order_relaxed);
+		ms.shift = (u32)(_data.shifts.load(std::memory_order_relaxed) >> shift_pos);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || seq != _data.seq.load(std::memory_order_relaxed));
+
+	return ms.convert(val);
+}
+
+inline
+u64 clock_params::cycles2nsec(u64 cycles)
+{
+	return convert(cycles, _data.cyc2ns_mult, 0);
+}
+
+inline
+u64 clock_params::nsec2cycles(u64 nsecs)
+{
+	return convert(nsecs, _data.ns2cyc_mult, 32);
+}
+
+inline
+u64 clock_params::tsc2ns(u64 tsc)
+{
+	snapshot snap;
+	read(snap);
+
+	// tsc may have been read just before a recalibration moved cyc_base past it
+	if (tsc >= snap.cyc_base)
+		return snap.ns_base + snap.cyc2ns.convert(tsc - snap.cyc_base);
+	else
+		return snap.ns_base - snap.cyc2ns.convert(snap.cyc_base - tsc);
+}
@@ -0,0 +1,118 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+#include "time_unit.h"
+
+/**
+ * DESCRIPTION:
+ * Stress test for recalibration of cpu_hz while other threads are creating
+ * and converting cycles time_units.
+ *
+ * One thread keeps switching cpu_hz between two values.  The other threads
+ * construct cycles time_units and check that every set of clock parameters
+ * they read belongs to one of the two calibrations (i.e., no torn
+ * mult/shift/offset tuples).
+ *
+ * usage: clock_params_test [nr_threads] [seconds]
+ */
+
+constexpr double hz_a = 3010643978;
+constexpr double hz_b = 2400000000;
+
+static atomic<bool> done(false);
+static atomic<u64> nr_torn(0);
+static atomic<u64> nr_reads(0);
+
+static bool matches(const clock_params::snapshot &snap, double hz)
+{
+	mult_shift cyc2ns, ns2cyc;
+	clock_params::calc(hz, cyc2ns, ns2cyc);
+
+	return snap.hz == hz
+		&& snap.cyc2ns.mult == cyc2ns.mult && snap.cyc2ns.shift == cyc2ns.shift
+		&& snap.ns2cyc.mult == ns2cyc.mult && snap.ns2cyc.shift == ns2cyc.shift;
+}
+
+static void reader()
+{
+	const u64 one_sec_a = mult_shift::calc((u64)1E9, (u64)hz_a).convert((u64)1E9);
+	const u64 one_sec_b = mult_shift::calc((u64)1E9, (u64)hz_b).convert((u64)1E9);
+	u64 reads = 0;
+	u64 torn = 0;
+	clock_params::snapshot snap;
+	clock_params::snapshot prev_snap;
+
+	clock_params::read(prev_snap);
+
+	while (!done.load(memory_order_relaxed)) {
+		time_unit tu(true);
+
+		// nsecs -> cycles goes through the published parameters
+		tu.set_seconds(1);
+		if (tu._cycles != one_sec_a && tu._cycles != one_sec_b)
+			++torn;
+
+		clock_params::read(snap);
+		if (!matches(snap, hz_a) && !matches(snap, hz_b))
+			++torn;
+
+		// the offset must only ever move forward
+		if (snap.cyc_base < prev_snap.cyc_base || snap.ns_base < prev_snap.ns_base)
+			++torn;
+		prev_snap = snap;
+
+		++reads;
+	}
+
+	nr_torn += torn;
+	nr_reads += reads;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned nr_threads = thread::hardware_concurrency();
+	unsigned seconds = 2;
+
+	if (argc > 1)
+		nr_threads = (unsigned)atoi(argv[1]);
+	if (argc > 2)
+		seconds = (unsigned)atoi(argv[2]);
+
+	time_unit::set_cpu_hz(hz_a);
+
+	vector<thread> threads;
+	for (unsigned i=0; i<nr_threads; ++i)
+		threads.push_back(thread(reader));
+
+	time_unit stop = time_unit::NOW(false);
+	stop.add_sec(seconds);
+
+	u64 nr_recalibrations = 0;
+	while (!(time_unit::NOW(false) >= stop)) {
+		time_unit::set_cpu_hz((nr_recalibrations & 1) ? hz_a : hz_b);
+		++nr_recalibrations;
+	}
+
+	done = true;
+	for (auto &t : threads)
+		t.join();
+
+	cout << "threads: " << nr_threads << endl;
+	cout << "recalibrations: " << nr_recalibrations << endl;
+	cout << "reads: " << nr_reads << endl;
+	cout << "torn reads: " << nr_torn << endl;
+
+	if (nr_torn) {
+		cout << "FAILED" << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "PASSED" << endl;
+	return EXIT_SUCCESS;
+}
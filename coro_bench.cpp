@@ -0,0 +1,147 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "coro_scheduler.h"
+#include "preempt_histogram.h"
+#include "bench_helpers.h"
+
+/**
+ * DESCRIPTION:
+ * Cost of a timed wakeup: periodic tasks (each wakes up every period, at a
+ * random phase, for a number of periods) as
+ *
+ * 	- coroutines on one thread (co_await until(), see coro_scheduler.h)
+ * 	- one thread per task (sleep_absolute())
+ *
+ * Reports the cpu time per wakeup (suspending, the timer, the switch to the
+ * task and back) and the wakeup latency.
+ *
+ * usage: coro_bench [tasks (default 10000)] [threads (default 1000)]
+ * 	[period usecs (default 10000)] [periods (default 100)]
+ */
+
+static void
+report(const char *name, size_t n, const preempt_histogram &latency, u64 cpu, u64 wall)
+{
+	printf("%-17s %6zu  latency (usecs)", name, n);
+	print_latency_usecs(latency);
+	print_cpu_usage(cpu, wall, latency.count(), "wakeup");
+	printf("\n");
+}
+
+static coro_task
+periodic_task(time_unit first, u64 period_ns, unsigned nr_periods, preempt_histogram &latency)
+{
+	time_unit next = first;
+
+	for (unsigned i=0; i<nr_periods; ++i) {
+		next.add_ns(period_ns);
+		co_await next.until();
+
+		latency.record((u64)time_unit::NOW(false).diff(next).nanosecs());
+	}
+}
+
+static void
+periodic_thread(time_unit first, u64 period_ns, unsigned nr_periods, preempt_histogram &latency)
+{
+	time_unit next = first;
+
+	for (unsigned i=0; i<nr_periods; ++i) {
+		next.add_ns(period_ns);
+		next.sleep_absolute();
+
+		latency.record((u64)time_unit::NOW(false).diff(next).nanosecs());
+	}
+}
+
+// random phases, so the wakeups are spread over the period
+static vector<time_unit>
+phases(size_t n, u64 period_ns)
+{
+	mt19937_64 rng(n);
+	uniform_int_distribution<u64> dist(0, period_ns);
+
+	time_unit now = time_unit::NOW(false);
+
+	vector<time_unit> first(n, now);
+	for (auto &t : first)
+		t.add_ns(dist(rng));
+
+	return first;
+}
+
+static void
+bench_coro(size_t n, u64 period_ns, unsigned nr_periods)
+{
+	coro_scheduler sched;
+	preempt_histogram latency;
+
+	u64 wall = time_unit::NOW(false).get_nanosecs();
+	u64 cpu = process_cpu_ns();
+
+	for (const auto &first : phases(n, period_ns))
+		sched.spawn(periodic_task(first, period_ns, nr_periods, latency));
+	sched.run();
+
+	cpu = process_cpu_ns() - cpu;
+	wall = time_unit::NOW(false).get_nanosecs() - wall;
+
+	report("coroutines", n, latency, cpu, wall);
+}
+
+static void
+bench_threads(size_t n, u64 period_ns, unsigned nr_periods)
+{
+	// one histogram per thread, merged after
+	vector<preempt_histogram> latency(n);
+	vector<thread> threads;
+	threads.reserve(n);
+
+	u64 wall = time_unit::NOW(false).get_nanosecs();
+	u64 cpu = process_cpu_ns();
+
+	vector<time_unit> first = phases(n, period_ns);
+	for (size_t i=0; i<n; ++i)
+		threads.emplace_back(periodic_thread, first[i], period_ns, nr_periods, ref(latency[i]));
+
+	for (auto &t : threads)
+		t.join();
+
+	cpu = process_cpu_ns() - cpu;
+	wall = time_unit::NOW(false).get_nanosecs() - wall;
+
+	preempt_histogram all;
+	for (const auto &h : latency)
+		all.merge(h);
+
+	report("thread per task", n, all, cpu, wall);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nr_tasks = argc > 1 ? (size_t)strtoull(argv[1], NULL, 0) : 10000;
+	size_t nr_threads = argc > 2 ? (size_t)strtoull(argv[2], NULL, 0) : 1000;
+	u64 period_ns = (argc > 3 ? strtoull(argv[3], NULL, 0) : 10000) * 1000;
+	unsigned nr_periods = argc > 4 ? (unsigned)atoi(argv[4]) : 100;
+
+	if (!nr_tasks || !nr_threads || !period_ns || !nr_periods) {
+		cout << "usage: " << argv[0] << " [tasks] [threads] [period usecs] [periods]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "period " << period_ns / 1000 << " usecs, " << nr_periods << " periods" << endl;
+
+	bench_coro(nr_tasks, period_ns, nr_periods);
+	bench_coro(nr_threads, period_ns, nr_periods);
+	bench_threads(nr_threads, period_ns, nr_periods);
+
+	return EXIT_SUCCESS;
+}
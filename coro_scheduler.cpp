@@ -0,0 +1,111 @@
+#include <stdlib.h>
+
+#include <exception>
+#include <iostream>
+using namespace std;
+
+#include "coro_scheduler.h"
+
+thread_local coro_scheduler *coro_scheduler::_current = nullptr;
+
+coro_task::promise_type::~promise_type()
+{
+	if (sched)
+		sched->_nr_tasks--;
+}
+
+void
+coro_task::promise_type::unhandled_exception()
+{
+	cout << "exception escaped a coro_task, exiting." << endl;
+	terminate();
+}
+
+coro_task::~coro_task()
+{
+	// never spawned
+	if (_handle)
+		_handle.destroy();
+}
+
+bool
+sleep_awaiter::await_ready() const
+{
+	return time_unit::NOW(false).get_nanosecs() >= _deadline_ns;
+}
+
+void
+sleep_awaiter::await_suspend(coroutine_handle<> h)
+{
+	coro_scheduler *sched = coro_scheduler::current();
+	if (!sched) {
+		cout << "until()/after() awaited outside of coro_scheduler::run(), exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	_handle = h;
+	sched->wheel().add(_timer, _deadline_ns);
+}
+
+void
+sleep_awaiter::on_expire(timer_wheel::timer &t, u64)
+{
+	((sleep_awaiter *)t.data)->_handle.resume();
+}
+
+sleep_awaiter
+time_unit::until() const
+{
+	return sleep_awaiter(get_monotonic_nanosecs());
+}
+
+sleep_awaiter
+time_unit::after() const
+{
+	return sleep_awaiter(time_unit::NOW(false).get_nanosecs() + get_nanosecs());
+}
+
+coro_scheduler::coro_scheduler(time_unit tick)
+	: _wheel(tick), _nr_tasks(0)
+{
+}
+
+coro_scheduler::~coro_scheduler()
+{
+	for (auto h : _ready)
+		h.destroy();
+}
+
+void
+coro_scheduler::spawn(coro_task task)
+{
+	task._handle.promise().sched = this;
+	_ready.push_back(task._handle);
+	task._handle = nullptr;
+
+	_nr_tasks++;
+}
+
+void
+coro_scheduler::run()
+{
+	coro_scheduler *prev = _current;
+	_current = this;
+
+	vector<coroutine_handle<>> ready;
+
+	while (_nr_tasks) {
+		if (_ready.empty()) {
+			_wheel.run_once();
+			continue;
+		}
+
+		// tasks may spawn tasks
+		ready.swap(_ready);
+		for (auto h : ready)
+			h.resume();
+		ready.clear();
+	}
+
+	_current = prev;
+}
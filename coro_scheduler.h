@@ -0,0 +1,132 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Timed coroutines (C++20) on one thread: a coroutine suspends until a
+ * time_unit instant, or for a time_unit length, without blocking the thread,
+ * so one thread multiplexes any number of timed tasks.
+ *
+ * 	coro_task blink(int led, int times)
+ * 	{
+ * 		time_unit next = time_unit::NOW(false);
+ * 		for (int i=0; i<times; ++i) {
+ * 			toggle(led);
+ * 			next.add_ns(500 * 1000 * 1000);
+ * 			co_await next.until();
+ * 		}
+ * 		co_await time_unit::MILLISECS(5).after();
+ * 		toggle(led);
+ * 	}
+ *
+ * 	coro_scheduler sched;
+ * 	sched.spawn(blink(0, 10));
+ * 	sched.spawn(blink(1, 20));
+ * 	sched.run();
+ *
+ * The expiry queue is a timer_wheel (see timer_wheel.h), so waiting and
+ * waking are O(1) and the tick is the batching granularity.  The wheel's
+ * timer lives in the awaiter (in the suspended coroutine's frame), nothing is
+ * allocated per wait.
+ *
+ * until()/after() may only be awaited by tasks of the scheduler running on
+ * the calling thread (see coro_scheduler::current()).  A wait for an instant
+ * that passed does not suspend.
+ */
+
+#include <coroutine>
+#include <vector>
+
+#include "data_types.h"
+#include "time_unit.h"
+#include "timer_wheel.h"
+
+class coro_scheduler;
+
+// a task of a coro_scheduler, started by coro_scheduler::spawn()
+class coro_task {
+	public:
+		struct promise_type {
+			coro_scheduler *sched = nullptr;
+
+			~promise_type();
+
+			coro_task get_return_object(void)
+			{
+				return coro_task(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+
+			// started by the scheduler, destroyed once done
+			std::suspend_always initial_suspend(void) { return {}; }
+			std::suspend_never final_suspend(void) noexcept { return {}; }
+
+			void return_void(void) {}
+			void unhandled_exception(void);
+		};
+
+		coro_task(coro_task &&other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+		~coro_task();
+
+		coro_task(const coro_task &) = delete;
+		coro_task &operator=(const coro_task &) = delete;
+		coro_task &operator=(coro_task &&) = delete;
+
+	private:
+		friend class coro_scheduler;
+
+		explicit coro_task(std::coroutine_handle<promise_type> h) : _handle(h) {}
+
+		std::coroutine_handle<promise_type> _handle;
+};
+
+// returned by time_unit::until() and time_unit::after()
+class sleep_awaiter {
+	public:
+		explicit sleep_awaiter(u64 deadline_ns)
+			: _deadline_ns(deadline_ns), _timer(on_expire, this) {}
+
+		// must not move once suspended (the wheel points to _timer)
+		sleep_awaiter(const sleep_awaiter &) = delete;
+		sleep_awaiter &operator=(const sleep_awaiter &) = delete;
+
+		bool await_ready(void) const;
+		void await_suspend(std::coroutine_handle<> h);
+		void await_resume(void) const {}
+
+	private:
+		static void on_expire(timer_wheel::timer &t, u64 now_ns);
+
+		const u64 _deadline_ns;
+		timer_wheel::timer _timer;
+		std::coroutine_handle<> _handle;
+};
+
+class coro_scheduler {
+	public:
+		explicit coro_scheduler(time_unit tick=time_unit::NANOSECS(timer_wheel::default_tick_ns));
+		~coro_scheduler();  // after run() returned (destroys tasks never started)
+
+		coro_scheduler(const coro_scheduler &) = delete;
+		coro_scheduler &operator=(const coro_scheduler &) = delete;
+
+		// @task runs once run() is called (or, if running, after the current task)
+		void spawn(coro_task task);
+
+		// until every task finished
+		void run(void);
+
+		size_t nr_tasks(void) const { return _nr_tasks; }
+		timer_wheel &wheel(void) { return _wheel; }
+
+		// the scheduler run() by the calling thread, nullptr if none
+		static coro_scheduler *current(void) { return _current; }
+
+	private:
+		friend struct coro_task::promise_type;
+
+		timer_wheel _wheel;
+		std::vector<std::coroutine_handle<>> _ready;
+		size_t _nr_tasks;
+
+		static thread_local coro_scheduler *_current;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Helpers for pinning threads to cpus.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+static inline bool
+pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * @return - ids of the cpus this process may run on (empty on failure)
+ */
+static inline std::vector<int>
+allowed_cpus(void)
+{
+	std::vector<int> cpus;
+	cpu_set_t allowed;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return cpus;
+
+	for (int cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, &allowed))
+			cpus.push_back(cpu);
+	}
+
+	return cpus;
+}
+
+/**
+ * Parses a cpu list in the format of /sys/devices/system/cpu/online (e.g.,
+ * "0,2-5,8").
+ *
+ * @return - the cpus in the order listed (empty on a malformed list)
+ */
+static inline std::vector<int>
+parse_cpu_list(const std::string &list)
+{
+	std::vector<int> cpus;
+	const char *p = list.c_str();
+
+	while (*p) {
+		char *end;
+		long first = strtol(p, &end, 10);
+		if (end == p || first < 0 || first >= CPU_SETSIZE)
+			return std::vector<int>();
+
+		long last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first || last >= CPU_SETSIZE)
+				return std::vector<int>();
+		}
+
+		for (long cpu=first; cpu<=last; ++cpu)
+			cpus.push_back((int)cpu);
+
+		if (*end == ',')
+			++end;
+		else if (*end)
+			return std::vector<int>();
+		p = end;
+	}
+
+	return cpus;
+}
@@ -1,4 +1,5 @@
 #include <csignal>
+#include <cmath>
 
 #include <iostream>
 #include <fstream>
@@ -8,18 +9,13 @@ using namespace std;
 #include "x86_tsc.h"
 
 #include "cpu_consumer.h"
+#include "tsc_skew.h"
+#include "preempt_trace.h"
+#include "cpu_time.h"
 #include "gcc_helpers/debug.h"
 
 volatile bool cpu_consumer::stop_program = false;
-bool cpu_consumer::do_record = false;
-
-ssize_t cpu_consumer::preempt_pts_curr_idx = 0;
-uint64_t* cpu_consumer::preempt_pts = nullptr;
-
-time_unit cpu_consumer::run_time = time_unit(true);
-time_unit cpu_consumer::max_preempt = time_unit(true);
-time_unit cpu_consumer::exec_time = time_unit(true);
-time_unit cpu_consumer::solo_cycle = time_unit(true);
+volatile bool cpu_consumer::start_requested = false;
 
 const string PROGRAM_NAME = "cpu_consumer";
 
@@ -29,9 +25,50 @@ void SIG_handler(int)
 	cpu_consumer::stop_program = true;
 }
 
+// only ever runs inside wait_for_start()'s sigsuspend(), see there
 void SIG_start(int)
 {
-	cout << "Signal start caught (" << PROGRAM_NAME << ")" << endl;
+	cpu_consumer::start_requested = true;
+}
+
+/**
+ * Rare part of trial_loop(): an iteration of @curr - @before cycles was
+ * preempted.  Kept out of line so that the loop itself stays short.
+ *
+ * @return - TSC value the next iteration starts at
+ */
+template <bool is_init, bool per_gap>
+__attribute__((noinline, cold))
+u64 cpu_consumer::on_preempt(consumer_state &s, u64 before, u64 curr, u64 &max_preempt,
+		u64 &nr_preempts)
+{
+	u64 diff = curr - before;
+
+	nr_preempts++;
+
+	// checking if !first_iteration is not be necessary
+	// max_preempt is not used in initialization code
+	// if the thread is preempted, on the first iteration and it takes
+	// a long time, this is still a valid max_preempt
+
+	// track the largest length of time this thread is preempted
+	if (diff > max_preempt)
+		max_preempt = diff;
+
+	if (is_init)
+		return curr;
+
+	s.preempts.record(diff);
+
+	// store preemption time interval (dropped and counted if the ring is
+	// full)
+	if (s.ring)
+		s.ring->push(preempt_interval{before, curr});
+
+	if (per_gap)
+		return s.attr.gap(diff);
+
+	return curr;
 }
 
 /**
@@ -48,11 +85,15 @@ void SIG_start(int)
  * @max_preempt
  * 		(out) - maximum continuous length of time execution was preempted
  *
+ * The lengths of all preemptions are recorded in s.preempts (measurement
+ * version only).
+ *
  * NOTE:
  * This function may be interrupted by a signal and may not run
  * all of run_time specified.
  *
- * is_init - init version of function used to initializes solo_cycle
+ * is_init - init version of function used to initializes solo_cycle (see
+ * init_loop(), the loop is the measurement loop plus keeping the minimum)
  *
  * !is_init - version used to measure cpu time (only slightly different than
  * the initialization function/loop).
@@ -60,111 +101,91 @@ void SIG_start(int)
  * exec - run_time is time to consume before exiting
  * !exec - run_time is wall-clock time to pass before exiting
  *
+ * per_gap - attribute every preemption to its cause (see
+ * preempt_attribution.h), the time spent reading the counters is neither
+ * counted as execution nor as preemption
+ *
+ * unroll - iterations per check of the exit condition
+ *
+ * @s is the calling thread's own state, everything else used by the loop is
+ * a local, so any number of threads can run trials at the same time.
  */
-template <bool is_init, bool exec>
-void cpu_consumer::trial_loop(time_unit& run_time, time_unit& exec_time, time_unit& max_preempt)
+template <bool is_init, bool exec, bool per_gap, unsigned unroll>
+void cpu_consumer::trial_loop(consumer_state &s, time_unit& run_time, time_unit& exec_time,
+		time_unit& max_preempt)
 {
-	// TODO: verify that solo_cycle is not be greater than max_no_preempt
-	// TODO: max_no_preempt is just an estimate, set automatically; maybe
-	// proportional to solo_cycle? Maybe obtain it from initialization
-	// function?
+	static_assert(unroll > 0, "unroll must be at least 1");
+
+	// Set by the initialization loop (see set_max_no_preempt()).
 	// Maybe compare with kernel's recorded number of context switches, but may
 	// detect other preemptions not counted as context switches by kernel.
-	const static time_unit max_no_preempt = time_unit::NANOSECS(200, true);
-	static time_unit total(true); total._cycles = 0;
-	int nr_preempts = 0;
+	const u64 max_no_preempt = s.max_no_preempt._cycles;
+	const u64 solo_cycle = s.solo_cycle._cycles;
+	u64 total = 0;
+	u64 nr_preempts = 0;
+	u64 max_preempt_cycles = 0;
 
 	// min is used to assign value to solo_cycle.
 	// Start with min being one sec, but assume it be much less than 1 sec.
-	const static time_unit one_sec = time_unit::SECS(1, true);
-	static time_unit min(true); min = one_sec;
+	const u64 one_sec = time_unit::SECS(1, true)._cycles;
+	u64 min = one_sec;
 
-	static time_unit before(true);
-	static time_unit diff(true);
+	s.preempts.reset();
 
-	max_preempt._cycles = 0;
+	time_unit begin(true); begin._cycles = read_tsc();
 
-	static time_unit begin(true); begin._cycles = read_tsc();
-	static time_unit stop(true);
-	if (!exec) {
-		// stop is not used if stop condition is a cpu time amount consumed
-		// could cause problems if run_time is set to the max (i.e., overflow)
-		stop = begin + run_time;
-	}
+	// The loop ends once progress (total for exec, the TSC for !exec)
+	// reaches limit, so both versions have the same shape.
+	// could cause problems if run_time is set to the max (i.e., overflow)
+	const u64 limit = exec ? run_time._cycles : begin._cycles + run_time._cycles;
 
-	static time_unit curr(true); curr._cycles = read_tsc();
+	u64 curr = read_tsc();
 
 	// ensure diff = curr - before is large enough so that the first itertation
-	// is sure to overwrite min with diff. The issue is that diff may be may be
-	// very small on the first iteration (which would translate into a
-	// artificially samll solo_cycle value.
-	// NOTE: min is not used measuring loop, only used to initialize solo_cycle
+	// is sure to be counted as a preemption (not as a new min).  The issue is
+	// that diff may be very small on the first iteration (which would
+	// translate into a artificially samll solo_cycle value.
 	if (is_init)
-		curr._cycles -= one_sec._cycles;
+		curr -= one_sec;
 
 	// For achieving maximum accuracy this loop should be as short as possible.
-	// Each iteration (regardless of branches) should idealy take exactly the
-	// same amount of time.
+	// Each iteration (regardless of preemption) should idealy take exactly the
+	// same amount of time: the common path has no branches (masks instead),
+	// and the exit condition is only checked every unroll iterations.
 	while (stop_program == false) {
-		before._cycles = curr._cycles;
-		curr._cycles = read_tsc();
-
-		diff._cycles = curr._cycles - before._cycles;
-
-		if (diff._cycles > max_no_preempt._cycles) {
-			nr_preempts++;
-			// We were preempted, only count one solo_cycle worth
-			// of execution.  We have no way to know exactly how
-			// much time we actually consumed so just use the
-			// minimum amount we could have possibly consumed
-			total._cycles += solo_cycle._cycles;
-
-			// checking if !first_iteration is not be necessary
-			// max_preempt is not used in initialization code
-			// if the thread is preempted, on the first iteration and it takes
-			// a long time, this is still a valid max_preempt
-
-			// track the largest length of time this thread is preempted
-			if (diff._cycles > max_preempt._cycles)
-				max_preempt._cycles = diff._cycles;
-
-			if (do_record) {
-				// store preemption time interval
-				if (preempt_pts_curr_idx <= preempt_pts_last_usable_idx) {
-					preempt_pts[preempt_pts_curr_idx++] = before._cycles;
-					preempt_pts[preempt_pts_curr_idx++] = curr._cycles;
-				} else {
-					cout << "out of preemption point storage, exiting." << endl;
-					break;
-				}
-			}
-		} else {
-			// NOT preempted. Therefore know EXACTLY how much time was consumed
-			// in this iteration (i.e., diff cycles).
-			total._cycles = total._cycles + diff._cycles;
+		for (unsigned i=0; i<unroll; ++i) {
+			u64 before = curr;
+			curr = read_tsc();
+			u64 diff = curr - before;
+
+			// all ones if preempted
+			u64 preempted = 0 - (u64)(diff > max_no_preempt);
 
-			// update min, which is used to obtain solo_cycle value
-			// TODO: maybe use a dummy variable operation as an else statement to
-			// make the loop iteration closer to being equal for all code paths
+			// NOT preempted: we know EXACTLY how much time was consumed
+			// in this iteration (i.e., diff cycles).
+			// Preempted: only count one solo_cycle worth of execution.
+			// We have no way to know exactly how much time we actually
+			// consumed so just use the minimum amount we could have
+			// possibly consumed.
+			total += (solo_cycle & preempted) | (diff & ~preempted);
 
 			// NOTE: min is only updated if not preempted (certainly if
 			// preempted, the value cannot be the min time to execute loop)
-
-			// In the measurement (vs initialization) version of the loop, min is not used.
 			// min is only used to set solo_cycle in the initialization loop
-			if (diff._cycles < min._cycles)
-				min._cycles = diff._cycles;
-		}
+			if (is_init) {
+				u64 smaller = ~preempted & (0 - (u64)(diff < min));
+				min = (diff & smaller) | (min & ~smaller);
+			}
 
-		if (exec) {
-			if (total._cycles >= run_time._cycles)
-				break;
-		} else {
-			if (curr._cycles > stop._cycles)
-				break;
+			if (__builtin_expect(preempted, 0))
+				curr = on_preempt<is_init, per_gap>(s, before, curr,
+						max_preempt_cycles, nr_preempts);
 		}
+
+		if ((exec ? total : curr) >= limit)
+			break;
 	}
-	static time_unit trial_run_time(true);
+	time_unit trial_run_time(true);
 	trial_run_time._cycles = read_tsc() - begin._cycles;
 
 	// NOTE: don't reset solo_cycle in measurement loop so as to allow it to be
@@ -174,10 +195,12 @@ void cpu_consumer::trial_loop(time_unit& run_time, time_unit& exec_time, time_un
 			cout << "min not updated, unable to initialize solo_cycle, exiting." << endl;
 			exit(EXIT_FAILURE);
 		}
-		solo_cycle = min;
+		s.solo_cycle._cycles = min;
+		set_max_no_preempt(s);
 	}
 
-	exec_time._cycles = total._cycles;
+	max_preempt._cycles = max_preempt_cycles;
+	exec_time._cycles = total;
 	if (!exec) {
 		if (exec_time._cycles > run_time._cycles) {
 			cout << "Warning: exec_time > run_interval, setting exec_time = run_interval." << endl;
@@ -189,39 +212,461 @@ void cpu_consumer::trial_loop(time_unit& run_time, time_unit& exec_time, time_un
 		}
 	}
 	run_time = trial_run_time;
+	s.nr_preempts = nr_preempts;
+}
 
-	//cout << "nr_preempts: " << nr_preempts << endl;
+/**
+ * Records the length of every iteration of a loop reading the TSC, for
+ * @run_time, in s.iterations.
+ */
+void
+cpu_consumer::record_iterations(consumer_state &s, time_unit run_time)
+{
+	s.iterations.reset();
+
+	u64 curr = read_tsc();
+	const u64 limit = curr + run_time._cycles;
+
+	while (stop_program == false && curr < limit) {
+		u64 before = curr;
+		curr = read_tsc();
+		s.iterations.record(curr - before);
+	}
 }
 
+/**
+ * Initializes max_no_preempt and solo_cycle, in two passes of half of
+ * @run_time each:
+ *
+ * 	1. record_iterations(), for set_max_no_preempt()
+ * 	2. trial_loop<is_init>(), the shortest iteration is solo_cycle
+ *
+ * Recording an iteration costs more than the rest of it, so the second pass
+ * does not: solo_cycle is that of the loop that measures, and it is told
+ * apart from preemptions by the threshold of the first pass.  The iterations
+ * of the first pass are longer than those of the measurement loop, so
+ * max_no_preempt errs towards not counting jitter as preemptions.
+ *
+ * @run_time
+ * 		(in)  - length of both passes
+ * 		(out) - wall-clock time elapsed
+ */
+template <unsigned unroll>
+void cpu_consumer::init_loop(consumer_state &s, time_unit& run_time, time_unit& exec_time,
+		time_unit& max_preempt)
+{
+	const u64 begin = read_tsc();
+
+	time_unit pass_time(true);
+	pass_time._cycles = run_time._cycles / 2;
+	record_iterations(s, pass_time);
+
+	// solo_cycle is not known yet: only from the iterations
+	s.solo_cycle._cycles = 0;
+	set_max_no_preempt(s);
+
+	pass_time._cycles = run_time._cycles - run_time._cycles / 2;
+	trial_loop<true, false, false, unroll>(s, pass_time, exec_time, max_preempt);
+
+	run_time._cycles = read_tsc() - begin;
+}
+
+/**
+ * Choose the length of an iteration above which trial_loop() counts it as a
+ * preemption, from the lengths of all iterations of the initialization loop
+ * (s.iterations).
+ *
+ * Real preemptions are rare (far less than 1 in 10000 iterations), so the
+ * no_preempt_percentile iteration is still ordinary loop jitter (cache
+ * misses, frequency changes, SMT siblings); anything no_preempt_multiplier
+ * times longer is not.  A fixed threshold would either hide short
+ * interruptions (SMIs, IRQs) on fast hosts or count jitter on slow/virtualized
+ * ones.
+ */
 void
-cpu_consumer::init_all()
+cpu_consumer::set_max_no_preempt(consumer_state &s)
+{
+	u64 jitter = s.iterations.percentile(no_preempt_percentile);
+
+	s.max_no_preempt = time_unit(true);
+	s.max_no_preempt._cycles = jitter * no_preempt_multiplier;
+
+	// solo_cycle is credited for every preemption, so it must not count
+	if (s.max_no_preempt._cycles < s.solo_cycle._cycles)
+		s.max_no_preempt._cycles = s.solo_cycle._cycles;
+}
+
+/**
+ * Duty cycle load: at the start of every @period consume a burst of cpu time
+ * (as consume_exec_time() does), then sleep until the next period (absolute
+ * release times, so the periods do not drift).
+ *
+ * The utilization the rest of the system sees is the thread's cpu time as
+ * accounted by the kernel, which is more than the bursts: the kernel also
+ * charges the thread for interrupts that preempt it (trial_loop() does not
+ * count them as execution) and for the sleeps/wakeups.  So the burst length
+ * is adjusted by an integral controller until the kernel's accounting
+ * (CLOCK_THREAD_CPUTIME_ID) matches @utilization.
+ *
+ * @run_time
+ * 		(in)  - length of the load (whole periods only)
+ * 		(out) - wall-clock time elapsed
+ *
+ * @exec_time
+ * 		(out) - total of the bursts
+ *
+ * @d - how closely the utilization was tracked
+ */
+template <bool per_gap>
+void cpu_consumer::duty_cycle_loop(consumer_state &s, double utilization, time_unit period,
+		time_unit& run_time, time_unit& exec_time, time_unit& max_preempt,
+		duty_cycle_result &d)
 {
+	const double period_ns = (double)period.get_nanosecs();
+	const double target_ns = utilization * period_ns;
+
+	preempt_histogram preempts;
+	u64 nr_preempts = 0;
+	double burst_ns = target_ns < period_ns ? target_ns : period_ns;
+	double integral = 0;
+	double abs_error = 0;
+
+	d.target = utilization;
+	exec_time._cycles = 0;
+	max_preempt._cycles = 0;
+
+	time_unit begin = time_unit::NOW(false);
+	time_unit end = begin;
+	end.add_ns(run_time.get_nanosecs());
+
+	time_unit release = begin;
+	u64 cpu_begin = thread_cpu_ns();
+	u64 cpu_prev = cpu_begin;
+
+	while (stop_program == false) {
+		time_unit next = release;
+		next.add_ns((u64)period_ns);
+		if (next > end)
+			break;
+
+		time_unit burst = time_unit::NANOSECS((u64)burst_ns, true);
+		if (burst._cycles) {
+			time_unit burst_exec(true);
+			time_unit burst_max(true);
+
+			trial_loop<false, true, per_gap>(s, burst, burst_exec, burst_max);
+
+			exec_time._cycles += burst_exec._cycles;
+			if (burst_max > max_preempt)
+				max_preempt = burst_max;
+			nr_preempts += s.nr_preempts;
+			preempts.merge(s.preempts);
+		}
+
+		if (time_unit::NOW(false) >= next)
+			d.nr_overruns++;
+		else
+			next.sleep_absolute(false);
+
+		u64 cpu_now = thread_cpu_ns();
+		double error = target_ns - (double)(cpu_now - cpu_prev);
+		cpu_prev = cpu_now;
+
+		abs_error += fabs(error);
+		d.nr_periods++;
+
+		// no integration while the burst is clamped (anti-windup)
+		double next_burst = target_ns + duty_cycle_ki * (integral + error);
+		if (next_burst < 0) {
+			burst_ns = 0;
+		} else if (next_burst > period_ns) {
+			burst_ns = period_ns;
+		} else {
+			integral += error;
+			burst_ns = next_burst;
+		}
+
+		release = next;
+	}
+
+	u64 wall_ns = time_unit::NOW(false).diff(begin).nanosecs();
+	if (wall_ns)
+		d.achieved = (double)(cpu_prev - cpu_begin) / (double)wall_ns;
+	if (d.nr_periods)
+		d.mean_error = abs_error / (double)d.nr_periods / period_ns;
+
+	run_time._cycles = time_unit::nsec2cycles(wall_ns);
+	s.nr_preempts = nr_preempts;
+	s.preempts = preempts;
+}
+
+/**
+ * Runs the initialization (init_loop()) on the calling thread (which should
+ * be pinned) for @run_time.
+ *
+ * @return - solo_cycle, @iterations - lengths of the iterations of its first
+ * pass
+ */
+template <unsigned unroll>
+time_unit
+cpu_consumer::calibrate_solo_cycle(time_unit run_time, preempt_histogram &iterations)
+{
+	consumer_state s;
+	time_unit exec_time(true);
+	time_unit max_preempt(true);
+
+	init_loop<unroll>(s, run_time, exec_time, max_preempt);
+	iterations = s.iterations;
+
+	return s.solo_cycle;
+}
+
+template time_unit cpu_consumer::calibrate_solo_cycle<1>(time_unit, preempt_histogram &);
+template time_unit cpu_consumer::calibrate_solo_cycle<2>(time_unit, preempt_histogram &);
+template time_unit cpu_consumer::calibrate_solo_cycle<4>(time_unit, preempt_histogram &);
+template time_unit cpu_consumer::calibrate_solo_cycle<8>(time_unit, preempt_histogram &);
+
+/**
+ * @cpus - one consumer thread is pinned to each of these
+ * @do_record - record the preemption intervals to <@record_prefix>.<cpu>.trace
+ * @ring_size - number of intervals each thread can buffer for the drain thread
+ * @ring_mem - pages (and locking) of the rings, see mapped_buffer.h
+ */
+cpu_consumer::cpu_consumer(const vector<int> &cpus, bool do_record,
+		const string &record_prefix, size_t ring_size,
+		const mapped_buffer::options &ring_mem)
+	: _cpus(cpus), _do_record(do_record), _record_prefix(record_prefix),
+	_ring_size(ring_size), _ring_mem(ring_mem), _results(cpus.size()), _rings(cpus.size()),
+	_drain_stop(false), _generation(0), _cmd(command::init), _amt(true),
+	_nr_done(0), _attribute_gaps(false), _utilization(0), _period(true)
+{
+	if (_cpus.empty()) {
+		cout << "no cpus to run on, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
 	// use cycles for all time measurments
 	time_unit::default_use_cycles = true;
 
-	// storage for preemption time instants
-	// TODO: note that this memory is never freed
-	// TODO: do_record could be set to true after init_all() and cause a crash
-	// possible fix would be to create an object? (would also allow cleanup of memory)
-	if (do_record) {
-		preempt_pts = new u64[preempt_pts_size];
-		preempt_pts_curr_idx = 0;
-	}
+	// calibrate cpu_hz before any thread needs it
+	time_unit init(true);
 
 	init_signals();
 
-	init_solo_cycle();
+	// before any measurement, since it pins threads to each cpu
+	tsc_skew::probe();
+
+	// the threads started below inherit this mask, so the signals are only
+	// ever handled by the calling thread (see wait_for_start())
+	sigset_t old_mask;
+	signals_block(&old_mask);
+
+	for (size_t i=0; i<_cpus.size(); ++i)
+		_threads.emplace_back(&cpu_consumer::consumer_thread, this, i);
+
+	// length of time to execute the measurement loop for initialization (e.g., solo_cycle)
+	run(command::init, time_unit::SECS(2, true));
+
+	// every consumer thread created its ring before finishing init
+	if (_do_record)
+		_drain = thread(&cpu_consumer::drain_thread, this);
+
+	// SIGUSR1 stays blocked, wait_for_start() takes it
+	sigaddset(&old_mask, SIGUSR1);
+	CHECK(pthread_sigmask(SIG_SETMASK, &old_mask, NULL));
 }
 
+cpu_consumer::~cpu_consumer()
+{
+	{
+		lock_guard<mutex> lk(_lock);
+		_cmd = command::quit;
+		++_generation;
+	}
+	_start_cv.notify_all();
+
+	for (auto &t : _threads)
+		t.join();
+
+	// writes out what is left in the rings
+	if (_drain.joinable()) {
+		_drain_stop = true;
+		_drain.join();
+	}
+}
+
+/**
+ * Body of the thread pinned to _cpus[@idx]: waits for a command from run(),
+ * runs the trial, publishes its results and waits again.
+ */
 void
-cpu_consumer::init_solo_cycle()
+cpu_consumer::consumer_thread(size_t idx)
 {
-	// length of time to execute the measurement loop for initialization (e.g., solo_cycle)
-	time_unit init_run_time = time_unit::SECS(2, true);
+	// private to this thread, on its stack (and in its own cache lines)
+	consumer_state s;
+
+	if (!pin_to_cpu(_cpus[idx])) {
+		cout << "unable to pin consumer thread to cpu " << _cpus[idx] << ", exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// counts what this thread and cpu are interrupted by
+	bool attr_ok = s.attr.open(_cpus[idx]);
+
+	// created once pinned (the ring faults in its memory), so that the memory
+	// is local to this cpu and page faults do not show up as preemptions
+	if (_do_record) {
+		s.ring = new spsc_ring<preempt_interval>(_ring_size, _ring_mem);
+
+		lock_guard<mutex> lk(_lock);
+		_rings[idx].reset(s.ring);
+	}
 
-	preempt_pts_curr_idx = 0;
-	// used to initialize solo_cycle
-	trial_loop<true>(init_run_time, exec_time, max_preempt);
+	u64 generation = 0;
+	for (;;) {
+		command cmd;
+		time_unit amt(true);
+		bool per_gap;
+		double utilization;
+		time_unit period(true);
+		{
+			unique_lock<mutex> lk(_lock);
+			_start_cv.wait(lk, [&]() { return _generation != generation; });
+			generation = _generation;
+			cmd = _cmd;
+			amt = _amt;
+			per_gap = _attribute_gaps && attr_ok;
+			utilization = _utilization;
+			period = _period;
+		}
+
+		if (command::quit == cmd)
+			break;
+
+		time_unit run_time = amt;
+		time_unit exec_time(true);
+		time_unit max_preempt(true);
+		duty_cycle_result duty;
+		memset(&duty, 0, sizeof(duty));
+		u64 overflows = s.ring ? s.ring->overflows() : 0;
+
+		if (attr_ok)
+			s.attr.trial_begin();
+
+		switch (cmd) {
+		case command::init:
+			// used to initialize solo_cycle
+			init_loop(s, run_time, exec_time, max_preempt);
+			break;
+		case command::consume_time:
+			if (per_gap)
+				trial_loop<false, false, true>(s, run_time, exec_time, max_preempt);
+			else
+				trial_loop<false>(s, run_time, exec_time, max_preempt);
+			break;
+		case command::consume_exec_time:
+			if (per_gap)
+				trial_loop<false, true, true>(s, run_time, exec_time, max_preempt);
+			else
+				trial_loop<false, true>(s, run_time, exec_time, max_preempt);
+			break;
+		case command::duty_cycle:
+			if (per_gap)
+				duty_cycle_loop<true>(s, utilization, period, run_time, exec_time, max_preempt, duty);
+			else
+				duty_cycle_loop<false>(s, utilization, period, run_time, exec_time, max_preempt, duty);
+			break;
+		case command::quit:
+			break;
+		}
+
+		if (attr_ok)
+			s.attr.trial_end();
+
+		{
+			lock_guard<mutex> lk(_lock);
+			core_result &r = _results[idx];
+			r.cpu = _cpus[idx];
+			r.solo_cycle = s.solo_cycle;
+			r.max_no_preempt = s.max_no_preempt;
+			r.run_time = run_time;
+			r.exec_time = exec_time;
+			r.max_preempt = max_preempt;
+			// each preemption was counted as one solo_cycle of execution
+			r.stolen_time = time_unit(true);
+			r.stolen_time._cycles = s.preempts.total() - s.preempts.count() * s.solo_cycle._cycles;
+			r.nr_preempts = s.nr_preempts;
+			r.preempts = s.preempts;
+			r.nr_dropped = s.ring ? s.ring->overflows() - overflows : 0;
+			r.attribution = s.attr.get_result();
+			r.duty_cycle = duty;
+
+			if (++_nr_done == _threads.size())
+				_done_cv.notify_one();
+		}
+	}
+}
+
+/**
+ * Moves the recorded preemption intervals from the rings to the trace files
+ * until _drain_stop is set and the rings are empty.
+ */
+void
+cpu_consumer::drain_thread()
+{
+	constexpr size_t batch_size = 4096;
+	vector<preempt_interval> batch(batch_size);
+
+	vector<preempt_trace_writer> traces(_cpus.size());
+
+	for (size_t i=0; i<_cpus.size(); ++i) {
+		string filename = _record_prefix + "." + to_string(_cpus[i]) + ".trace";
+
+		if (!traces[i].open(filename, _cpus[i]))
+			exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		// read before draining, so nothing pushed before the stop is missed
+		bool stop = _drain_stop;
+		size_t drained = 0;
+
+		for (size_t i=0; i<_cpus.size(); ++i) {
+			size_t n = _rings[i]->pop(batch.data(), batch_size);
+
+			for (size_t j=0; j<n; ++j)
+				traces[i].append(batch[j].start, batch[j].end);
+			drained += n;
+		}
+
+		if (!drained) {
+			if (stop)
+				break;
+			time_unit::nanosleep((u64)1E6);
+		}
+	}
+
+	for (auto &t : traces) {
+		if (!t.close())
+			cout << "unable to write all preemption intervals." << endl;
+	}
+}
+
+/**
+ * Start @cmd on every consumer thread and wait until all of them are done.
+ */
+void
+cpu_consumer::run(command cmd, time_unit amt)
+{
+	unique_lock<mutex> lk(_lock);
+
+	_cmd = cmd;
+	_amt = amt;
+	_nr_done = 0;
+	++_generation;
+	_start_cv.notify_all();
+
+	_done_cv.wait(lk, [&]() { return _nr_done == _threads.size(); });
 }
 
 /**
@@ -230,9 +675,7 @@ cpu_consumer::init_solo_cycle()
 void
 cpu_consumer::consume_time(time_unit run_window_length)
 {
-	preempt_pts_curr_idx = 0;
-	run_time = run_window_length;
-	trial_loop<false>(run_time, exec_time, max_preempt);
+	run(command::consume_time, run_window_length);
 }
 
 /**
@@ -241,9 +684,34 @@ cpu_consumer::consume_time(time_unit run_window_length)
 void
 cpu_consumer::consume_exec_time(time_unit amt)
 {
-	preempt_pts_curr_idx = 0;
-	run_time = amt;
-	trial_loop<false, true>(run_time, exec_time, max_preempt);
+	run(command::consume_exec_time, amt);
+}
+
+/**
+ * Generate a load of @utilization (0 - 1) on every cpu for @duration (whole
+ * periods only).  See duty_cycle_loop().
+ */
+void
+cpu_consumer::duty_cycle(double utilization, time_unit period, time_unit duration)
+{
+	// also catches NaN
+	if (!(utilization >= 0 && utilization <= 1)) {
+		cout << "utilization " << utilization << " is not within 0 - 1, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (!period.get_nanosecs()) {
+		cout << "duty cycle period must not be 0, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	{
+		lock_guard<mutex> lk(_lock);
+		_utilization = utilization;
+		_period = period;
+	}
+
+	run(command::duty_cycle, duration);
 }
 
 void
@@ -255,6 +723,80 @@ cpu_consumer::max_nonpreempt()
 	consume_exec_time(long_time);
 }
 
+const vector<cpu_consumer::core_result> &
+cpu_consumer::results() const
+{
+	return _results;
+}
+
+time_unit
+cpu_consumer::exec_time() const
+{
+	time_unit total(true);
+	total._cycles = 0;
+
+	for (const auto &r : _results)
+		total._cycles += r.exec_time._cycles;
+
+	return total;
+}
+
+time_unit
+cpu_consumer::max_preempt() const
+{
+	time_unit max(true);
+	max._cycles = 0;
+
+	for (const auto &r : _results) {
+		if (r.max_preempt > max)
+			max = r.max_preempt;
+	}
+
+	return max;
+}
+
+time_unit
+cpu_consumer::stolen_time() const
+{
+	time_unit total(true);
+	total._cycles = 0;
+
+	for (const auto &r : _results)
+		total._cycles += r.stolen_time._cycles;
+
+	return total;
+}
+
+preempt_attribution::result
+cpu_consumer::attribution() const
+{
+	preempt_attribution::result all;
+	all.reset();
+
+	for (const auto &r : _results)
+		all.merge(r.attribution);
+
+	return all;
+}
+
+void
+cpu_consumer::set_attribute_gaps(bool per_gap)
+{
+	lock_guard<mutex> lk(_lock);
+	_attribute_gaps = per_gap;
+}
+
+preempt_histogram
+cpu_consumer::preempts() const
+{
+	preempt_histogram all;
+
+	for (const auto &r : _results)
+		all.merge(r.preempts);
+
+	return all;
+}
+
 void
 cpu_consumer::init_signals()
 {
@@ -262,32 +804,69 @@ cpu_consumer::init_signals()
 	sigemptyset(&sa.sa_mask);
 	sa.sa_flags = 0;
 
-	// register handler used to START measurement
+	// register handler used to STOP measurement
 	sa.sa_handler = SIG_handler;
 	sigaction(SIGTERM, &sa, 0);
 	sigaction(SIGINT, &sa, 0); // CTRL-C
 
-	// register handler used to STOP measurement
+	// register handler used to START measurement
 	sa.sa_handler = SIG_start;
 	sigaction(SIGUSR1, &sa, 0);
 }
 
+/**
+ * Blocks the signals of init_signals() in the calling thread.
+ *
+ * @old_mask - (out) the mask before
+ */
 void
-cpu_consumer::preempt_pts_to_file()
+cpu_consumer::signals_block(sigset_t *old_mask)
 {
-	if (!do_record) {
-		cout << "WARNING(" << __func__ << "): do_record is set to false, but trying to write pts!" << endl;
-		return;
-	}
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGUSR1);
+
+	CHECK(pthread_sigmask(SIG_BLOCK, &set, old_mask));
+}
+
+/**
+ * Waits for SIGUSR1 (e.g., sent to several hosts at once, so that their
+ * trials start together).  Must be called by the thread that created the
+ * cpu_consumer, which is the only one the signals are delivered to.
+ *
+ * SIGUSR1 is blocked everywhere else, so one sent before the wait (e.g.,
+ * during the last trial) stays pending; it is dropped, only a SIGUSR1 sent
+ * while waiting starts the trial.
+ *
+ * @return - false if SIGTERM/SIGINT arrived instead
+ */
+bool
+cpu_consumer::wait_for_start()
+{
+	sigset_t old_mask, usr1, wait_mask;
+	struct timespec no_wait = { 0, 0 };
+
+	// no signal can arrive between checking the flags and sigsuspend()
+	signals_block(&old_mask);
+
+	sigemptyset(&usr1);
+	sigaddset(&usr1, SIGUSR1);
+	while (sigtimedwait(&usr1, NULL, &no_wait) == SIGUSR1)
+		;
+	start_requested = false;
 
-	ofstream ostm_output;
-	string filename = "preempt_pts.dat";
+	wait_mask = old_mask;
+	sigdelset(&wait_mask, SIGUSR1);
+	while (!start_requested && !stop_program)
+		sigsuspend(&wait_mask);
 
-	ostm_output.open(filename.c_str(), ofstream::out);
+	start_requested = false;
 
-	ostm_output << "# " << (uint64_t)time_unit::_cpu_hz << endl;
-	for (int i=0; i<preempt_pts_curr_idx; ++i)
-		ostm_output << preempt_pts[i] << endl;
+	sigaddset(&old_mask, SIGUSR1);
+	CHECK(pthread_sigmask(SIG_SETMASK, &old_mask, NULL));
 
-	ostm_output.close();
+	return !stop_program;
 }
@@ -1,41 +1,221 @@
 #pragma once
 
+/*
+ * DESCRIPTION:
+ *
+ * Measures the cpu time available to (and the preemptions of) spinning
+ * threads, on several cpus at once.
+ *
+ * A cpu_consumer starts one thread per cpu, pinned to that cpu.  Each thread
+ * keeps its measurement state (consumer_state) on its own stack, cache line
+ * aligned, and records preemptions in its own buffer, so the threads share
+ * nothing while a trial runs.  Results are gathered into results() once every
+ * thread finished the trial.
+ *
+ * The threads are started (and solo_cycle is initialized on every cpu) by the
+ * constructor, and stopped by the destructor.
+ *
+ * Recording preemptions:
+ * Each thread pushes its preemption intervals into its own spsc_ring, which a
+ * drain thread empties into one trace file per cpu (<record_prefix>.<cpu>.trace,
+ * see preempt_trace.h), so the recording length is only limited by disk
+ * space.  If the drain thread falls behind, intervals are dropped and counted
+ * (core_result::nr_dropped), the measurement continues.  The rings are
+ * faulted in (optionally on hugepages and locked, see mapped_buffer.h) before
+ * the first trial, and freed with the cpu_consumer.
+ *
+ * Signals:
+ * SIGTERM/SIGINT stop the trial that is running (stop_program), SIGUSR1 ends
+ * wait_for_start().  They are blocked in the threads a cpu_consumer starts,
+ * so they are handled by the thread that created it.  That thread has
+ * SIGUSR1 blocked too, except while in wait_for_start(), which drops any
+ * sent before it.
+ */
+
 #include <sys/types.h>
+#include <signal.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "time_unit.h"
+#include "cpu_affinity.h"
+#include "spsc_ring.h"
+#include "preempt_histogram.h"
+#include "preempt_attribution.h"
 
 class cpu_consumer
 {
 public:
-	template <bool is_init, bool exec=false>
-	static void trial_loop(time_unit& run_time, time_unit& exec_time, time_unit& max_preempt);
+	// see duty_cycle()
+	struct duty_cycle_result {
+		double target;          // requested utilization
+		double achieved;        // thread cpu time / wall-clock time
+		double mean_error;      // mean |utilization error| of a period
+		u64 nr_periods;
+		u64 nr_overruns;        // bursts that ended after the next period began
+	};
 
-	static void consume_time(time_unit run_window_length);
-	static void consume_exec_time(time_unit amt);
-	static void max_nonpreempt(void);
+	// outcome of the last trial on one cpu
+	struct core_result {
+		int cpu;
+		time_unit solo_cycle;
+		time_unit max_no_preempt;  // longer iterations are preemptions
+		time_unit run_time;     // wall-clock time elapsed
+		time_unit exec_time;    // cpu time consumed
+		time_unit max_preempt;  // longest continuous preemption
+		time_unit stolen_time;  // run_time not available to the thread
+		u64 nr_preempts;
+		u64 nr_dropped;         // preemptions not recorded (ring full)
 
-	static void init_all();
-	static void init_signals();
-	static void init_solo_cycle();
+		// lengths (cycles) of all preemptions
+		preempt_histogram preempts;
 
-	static void preempt_pts_to_file();
+		// what the cpu/thread was interrupted by
+		preempt_attribution::result attribution;
 
-	static volatile bool stop_program;
-	static bool do_record;
+		// duty_cycle() only
+		duty_cycle_result duty_cycle;
+	};
+
+	// preemption, TSC values
+	struct preempt_interval {
+		u64 start;
+		u64 end;
+	};
+
+	// per cpu, in preemption intervals
+	static constexpr size_t default_ring_size = (size_t)1 << 16;
+
+	// see set_max_no_preempt()
+	static constexpr double no_preempt_percentile = 99.99;
+	static constexpr u64 no_preempt_multiplier = 4;
+
+	// iterations of trial_loop() per check of the exit condition
+	static constexpr unsigned default_unroll = 4;
+
+	// gain of the burst length controller, per period (see duty_cycle_loop())
+	static constexpr double duty_cycle_ki = 0.5;
 
-	static constexpr size_t preempt_pts_size = (size_t)1E8;
-	static constexpr ssize_t preempt_pts_last_usable_idx = preempt_pts_size - 2;
-	static_assert(preempt_pts_last_usable_idx >= 0, "preempt_pts_size is too small");
-	static ssize_t preempt_pts_curr_idx;
-	static uint64_t* preempt_pts;
+	explicit cpu_consumer(const std::vector<int> &cpus=allowed_cpus(), bool do_record=false,
+			const std::string &record_prefix="preempt_pts",
+			size_t ring_size=default_ring_size,
+			const mapped_buffer::options &ring_mem=mapped_buffer::options());
+	~cpu_consumer();
 
-	static time_unit solo_cycle;
-	static time_unit run_time;
-	static time_unit exec_time;
-	static time_unit max_preempt;
+	void consume_time(time_unit run_window_length);
+	void consume_exec_time(time_unit amt);
+	void max_nonpreempt(void);
+
+	/*
+	 * Background load: @utilization (0 - 1) of every cpu, as bursts of cpu
+	 * time at the start of every @period, for @duration.
+	 */
+	void duty_cycle(double utilization, time_unit period, time_unit duration);
+
+	const std::vector<core_result> &results(void) const;
+	time_unit exec_time(void) const;    // sum over all cpus
+	time_unit max_preempt(void) const;  // max over all cpus
+	time_unit stolen_time(void) const;  // sum over all cpus
+	preempt_histogram preempts(void) const;  // of all cpus
+	preempt_attribution::result attribution(void) const;  // sum over all cpus
+
+	/*
+	 * Attribute every preemption to its cause, instead of only counting
+	 * interrupts per trial (see preempt_attribution.h).  Slows down
+	 * measurements with many preemptions.
+	 */
+	void set_attribute_gaps(bool per_gap);
+
+	static void init_signals(void);
+
+	// blocks until SIGUSR1, false on SIGTERM/SIGINT
+	static bool wait_for_start(void);
+
+	// instantiated for unroll 1, 2, 4 and 8 (see solo_cycle_bench)
+	template <unsigned unroll=default_unroll>
+	static time_unit calibrate_solo_cycle(time_unit run_time, preempt_histogram &iterations);
+
+	static volatile bool stop_program;
+	static volatile bool start_requested;  // SIGUSR1 arrived
 
 private:
-	cpu_consumer();
+	// state of one consumer thread, only ever touched by that thread
+	struct alignas(64) consumer_state {
+		time_unit solo_cycle;
+		u64 nr_preempts;
+		preempt_histogram preempts;
+
+		// threshold and the iteration lengths it is taken from (init only)
+		time_unit max_no_preempt;
+		preempt_histogram iterations;
+
+		// nullptr if not recording
+		spsc_ring<preempt_interval> *ring;
+
+		preempt_attribution attr;
+
+		// until initialized, the threshold is an estimate
+		consumer_state() : solo_cycle(true), nr_preempts(0),
+			max_no_preempt(time_unit::NANOSECS(200, true)), ring(nullptr) {}
+	};
+
+	enum class command { init, consume_time, consume_exec_time, duty_cycle, quit };
+
+	template <bool is_init, bool exec=false, bool per_gap=false, unsigned unroll=default_unroll>
+	static void trial_loop(consumer_state &s, time_unit& run_time, time_unit& exec_time,
+			time_unit& max_preempt);
+
+	template <unsigned unroll=default_unroll>
+	static void init_loop(consumer_state &s, time_unit& run_time, time_unit& exec_time,
+			time_unit& max_preempt);
+	static void record_iterations(consumer_state &s, time_unit run_time);
+
+	template <bool per_gap>
+	static void duty_cycle_loop(consumer_state &s, double utilization, time_unit period,
+			time_unit& run_time, time_unit& exec_time, time_unit& max_preempt,
+			duty_cycle_result &d);
+
+	template <bool is_init, bool per_gap>
+	static u64 on_preempt(consumer_state &s, u64 before, u64 curr, u64 &max_preempt,
+			u64 &nr_preempts);
+
+	static void set_max_no_preempt(consumer_state &s);
+	static void signals_block(sigset_t *old_mask);
+
+	void consumer_thread(size_t idx);
+	void drain_thread(void);
+	void run(command cmd, time_unit amt);
+
+	const std::vector<int> _cpus;
+	const bool _do_record;
+	const std::string _record_prefix;
+	const size_t _ring_size;
+	const mapped_buffer::options _ring_mem;
+
+	std::vector<std::thread> _threads;
+	std::vector<core_result> _results;
+
+	// created by each consumer thread (once pinned), emptied by _drain
+	std::vector<std::unique_ptr<spsc_ring<preempt_interval>>> _rings;
+	std::thread _drain;
+	std::atomic<bool> _drain_stop;
+
+	// protects everything below, and the results between trials
+	mutable std::mutex _lock;
+	std::condition_variable _start_cv, _done_cv;
+	u64 _generation;
+	command _cmd;
+	time_unit _amt;
+	size_t _nr_done;
+	bool _attribute_gaps;
+	double _utilization;
+	time_unit _period;
 };
 
 void SIG_handler(int);
@@ -0,0 +1,338 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "cpu_consumer.h"
+#include "cpu_affinity.h"
+
+/**
+ * DESCRIPTION:
+ * Runs cpu_consumer trials and writes one JSON object per trial (one per
+ * line), for collecting jitter data from many hosts.
+ *
+ * usage: cpu_consumer [options]
+ * 	-t <secs>    run length of a trial (wall-clock, default 10)
+ * 	-e <secs>    exec budget: run until this much cpu time was consumed
+ * 	             (instead of -t)
+ * 	-u <util>    duty cycle: consume this fraction (0 - 1) of every period
+ * 	             for the run length (-t), see cpu_consumer::duty_cycle()
+ * 	-P <msecs>   duty cycle period (default 10)
+ * 	-c <cpus>    cpu list, e.g., 0,2-5 (default: all allowed cpus)
+ * 	-n <trials>  number of trials (default 1)
+ * 	-s           wait for SIGUSR1 before every trial
+ * 	-r <prefix>  record the preemptions to <prefix>.<cpu>.trace
+ * 	-b <n>       recording buffer of each cpu, in preemptions (default 65536)
+ * 	-p <pages>   pages of the recording buffers: normal, thp or hugetlb
+ * 	-l           lock the recording buffers in memory
+ * 	-g           attribute every preemption to its cause
+ * 	-o <path>    output (default: stdout)
+ *
+ * Only the JSON goes to stdout, progress and messages (including the cpu_hz
+ * calibration's) go to stderr.
+ *
+ * Durations in the output are in nsecs, the histogram buckets are
+ * [lowest nsecs, count] pairs of the non-empty buckets.
+ */
+
+static const double percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+
+static void
+usage(const char *prog)
+{
+	cout << "usage: " << prog << " [-t secs | -e secs] [-u utilization [-P msecs]] [-c cpus] [-n trials] [-s]"
+		" [-r prefix] [-b n] [-p normal|thp|hugetlb] [-l] [-g] [-o output]" << endl;
+	exit(EXIT_FAILURE);
+}
+
+// @str in units of @unit_ns nsecs
+static time_unit
+parse_duration(const char *str, double unit_ns)
+{
+	char *end;
+	double val = strtod(str, &end);
+
+	if (end == str || *end || val <= 0) {
+		cout << "invalid duration: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	return time_unit::NANOSECS((u64)(val * unit_ns), true);
+}
+
+static double
+parse_utilization(const char *str)
+{
+	char *end;
+	double util = strtod(str, &end);
+
+	if (end == str || *end || !(util >= 0 && util <= 1)) {
+		cout << "invalid utilization (0 - 1): " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	return util;
+}
+
+static double
+fraction(u64 part, u64 whole)
+{
+	return whole ? (double)part / (double)whole : 0;
+}
+
+static void
+write_histogram(FILE *out, const preempt_histogram &h)
+{
+	fprintf(out, "{\"count\":%llu,\"min_ns\":%llu,\"max_ns\":%llu",
+		(unsigned long long)h.count(),
+		(unsigned long long)time_unit::cycles2nsec(h.min()),
+		(unsigned long long)time_unit::cycles2nsec(h.max()));
+
+	for (double p : percentiles)
+		fprintf(out, ",\"p%g_ns\":%llu", p,
+			(unsigned long long)time_unit::cycles2nsec(h.percentile(p)));
+
+	fprintf(out, ",\"buckets\":[");
+	const char *sep = "";
+	for (size_t i=0; i<preempt_histogram::nr_buckets; ++i) {
+		u64 n = h.bucket_count(i);
+		if (!n)
+			continue;
+
+		fprintf(out, "%s[%llu,%llu]", sep,
+			(unsigned long long)time_unit::cycles2nsec(preempt_histogram::bucket_lowest(i)),
+			(unsigned long long)n);
+		sep = ",";
+	}
+	fprintf(out, "]}");
+}
+
+static void
+write_duty_cycle(FILE *out, const cpu_consumer::duty_cycle_result &d)
+{
+	fprintf(out, "{\"target\":%.9g,\"achieved\":%.9g,\"mean_error\":%.9g,"
+		"\"nr_periods\":%llu,\"nr_overruns\":%llu}",
+		d.target, d.achieved, d.mean_error,
+		(unsigned long long)d.nr_periods,
+		(unsigned long long)d.nr_overruns);
+}
+
+static void
+write_core(FILE *out, const cpu_consumer::core_result &r, bool duty)
+{
+	u64 run_ns = r.run_time.get_nanosecs();
+	u64 stolen_ns = r.stolen_time.get_nanosecs();
+
+	fprintf(out, "{\"cpu\":%d,\"run_time_ns\":%llu,\"exec_time_ns\":%llu,"
+		"\"max_preempt_ns\":%llu,\"stolen_time_ns\":%llu,\"stolen_fraction\":%.9g,"
+		"\"nr_preempts\":%llu,\"nr_dropped\":%llu,\"solo_cycle_ns\":%llu,"
+		"\"max_no_preempt_ns\":%llu,",
+		r.cpu,
+		(unsigned long long)run_ns,
+		(unsigned long long)r.exec_time.get_nanosecs(),
+		(unsigned long long)r.max_preempt.get_nanosecs(),
+		(unsigned long long)stolen_ns,
+		fraction(stolen_ns, run_ns),
+		(unsigned long long)r.nr_preempts,
+		(unsigned long long)r.nr_dropped,
+		(unsigned long long)r.solo_cycle.get_nanosecs(),
+		(unsigned long long)r.max_no_preempt.get_nanosecs());
+
+	const preempt_attribution::result &a = r.attribution;
+	fprintf(out, "\"attribution\":{\"ctxsw\":%llu,\"hard_irqs\":%llu,\"softirqs\":%llu",
+		(unsigned long long)a.counts.ctxsw,
+		(unsigned long long)a.counts.hard_irqs,
+		(unsigned long long)a.counts.softirqs);
+	if (a.have_smis)
+		fprintf(out, ",\"smis\":%llu", (unsigned long long)a.counts.smis);
+	fprintf(out, "},");
+
+	if (duty) {
+		fprintf(out, "\"duty_cycle\":");
+		write_duty_cycle(out, r.duty_cycle);
+		fprintf(out, ",");
+	}
+
+	fprintf(out, "\"histogram\":");
+	write_histogram(out, r.preempts);
+	fprintf(out, "}");
+}
+
+static void
+write_trial(FILE *out, const char *host, unsigned trial, u64 start_ns, const cpu_consumer &c,
+	bool duty)
+{
+	u64 run_ns = 0;
+	for (const auto &r : c.results())
+		run_ns += r.run_time.get_nanosecs();
+	u64 stolen_ns = c.stolen_time().get_nanosecs();
+
+	fprintf(out, "{\"host\":\"%s\",\"trial\":%u,\"start_realtime_ns\":%llu,"
+		"\"cpu_hz\":%.0f,\"exec_time_ns\":%llu,\"max_preempt_ns\":%llu,"
+		"\"stolen_time_ns\":%llu,\"stolen_fraction\":%.9g,\"histogram\":",
+		host, trial, (unsigned long long)start_ns, time_unit::cpu_hz(),
+		(unsigned long long)c.exec_time().get_nanosecs(),
+		(unsigned long long)c.max_preempt().get_nanosecs(),
+		(unsigned long long)stolen_ns,
+		fraction(stolen_ns, run_ns));
+	write_histogram(out, c.preempts());
+
+	fprintf(out, ",\"cores\":[");
+	const char *sep = "";
+	for (const auto &r : c.results()) {
+		fprintf(out, "%s", sep);
+		write_core(out, r, duty);
+		sep = ",";
+	}
+	fprintf(out, "]}\n");
+	fflush(out);
+}
+
+/**
+ * Point stdout (fd 1, so also the library's printf()s) at stderr.
+ *
+ * @return - the original stdout
+ */
+static FILE *
+stdout_to_stderr(void)
+{
+	int fd = dup(STDOUT_FILENO);
+	FILE *json = fd < 0 ? NULL : fdopen(fd, "w");
+
+	if (!json || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		cerr << "unable to redirect stdout, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	return json;
+}
+
+int main(int argc, char *argv[])
+{
+	// before anything is printed (e.g., by the calibration of the time_units)
+	FILE *json = stdout_to_stderr();
+
+	time_unit run_time = time_unit::SECS(10, true);
+	time_unit exec_budget(true);
+	bool use_exec = false;
+	double utilization = -1;
+	time_unit duty_period = time_unit::MILLISECS(10, true);
+	vector<int> cpus = allowed_cpus();
+	unsigned nr_trials = 1;
+	bool wait_signal = false;
+	bool do_record = false;
+	string record_prefix = "preempt_pts";
+	size_t ring_size = cpu_consumer::default_ring_size;
+	mapped_buffer::options ring_mem;
+	bool per_gap = false;
+	const char *output = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:e:u:P:c:n:sr:b:p:lgo:")) != -1) {
+		switch (opt) {
+		case 't':
+			run_time = parse_duration(optarg, 1E9);
+			break;
+		case 'e':
+			exec_budget = parse_duration(optarg, 1E9);
+			use_exec = true;
+			break;
+		case 'u':
+			utilization = parse_utilization(optarg);
+			break;
+		case 'P':
+			duty_period = parse_duration(optarg, 1E6);
+			break;
+		case 'c':
+			cpus = parse_cpu_list(optarg);
+			if (cpus.empty()) {
+				cout << "invalid cpu list: " << optarg << endl;
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'n':
+			nr_trials = (unsigned)atoi(optarg);
+			break;
+		case 's':
+			wait_signal = true;
+			break;
+		case 'r':
+			do_record = true;
+			record_prefix = optarg;
+			break;
+		case 'b':
+			ring_size = (size_t)strtoull(optarg, NULL, 0);
+			if (!ring_size)
+				usage(argv[0]);
+			break;
+		case 'p':
+			if (!mapped_buffer::parse_page_mode(optarg, ring_mem.pages))
+				usage(argv[0]);
+			break;
+		case 'l':
+			ring_mem.lock = true;
+			break;
+		case 'g':
+			per_gap = true;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	bool duty = utilization >= 0;
+	if (optind != argc || !nr_trials || (duty && use_exec))
+		usage(argv[0]);
+
+	FILE *out = json;
+	if (output) {
+		out = fopen(output, "w");
+		if (!out) {
+			cout << "unable to create " << output << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	char host[256] = "";
+	gethostname(host, sizeof(host) - 1);
+
+	cpu_consumer c(cpus, do_record, record_prefix, ring_size, ring_mem);
+	c.set_attribute_gaps(per_gap);
+
+	for (unsigned trial=0; trial<nr_trials && !cpu_consumer::stop_program; ++trial) {
+		if (wait_signal) {
+			cout << "waiting for SIGUSR1 (pid " << getpid() << ")" << endl;
+			if (!c.wait_for_start())
+				break;
+			cout << "SIGUSR1 caught, starting trial " << trial << endl;
+		}
+
+		u64 start_ns = time_unit::REALTIME().get_nanosecs();
+		if (duty)
+			c.duty_cycle(utilization, duty_period, run_time);
+		else if (use_exec)
+			c.consume_exec_time(exec_budget);
+		else
+			c.consume_time(run_time);
+
+		write_trial(out, host, trial, start_ns, c, duty);
+	}
+
+	if (out != json)
+		fclose(json);
+
+	if (fclose(out)) {
+		cout << "error writing output" << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -6,6 +6,7 @@
 
 #include "time_period.h"
 #include "time_unit.h"
+#include "tsc_calibration.h"
 
 /**
  * DESCRIPTION:
@@ -63,6 +64,12 @@
 
 bool done = false;
 
+static void print_calibration(const tsc_calibration &cal)
+{
+	if (cal.valid())
+		printf("%-8s: %14.2f (+/- %.2f ppm)\n", cal.source_str(), cal.hz, cal.error_ppm);
+}
+
 void SIG_handler(int)
 {
 	done = true;
@@ -80,6 +87,11 @@ int main()
 	sigaction(SIGTERM, &sa, 0);
 	sigaction(SIGINT, &sa, 0);  // ctrl-c
 
+	// quick estimates, for comparison with the ntp calibration below
+	print_calibration(tsc_calibration::from_cpuid());
+	print_calibration(tsc_calibration::from_kernel());
+	print_calibration(tsc_calibration::measure());
+
 	printf("press ctrl-c to stop calibration\n");
 
 	time_period time(true);
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * CPU time used, as accounted by the kernel (as opposed to the wall clock
+ * time time_unit measures).
+ */
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "data_types.h"
+#include "gcc_helpers/debug.h"
+
+// user + system time of the whole process (every thread)
+static inline u64
+process_cpu_ns(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ((u64)ru.ru_utime.tv_sec + (u64)ru.ru_stime.tv_sec) * (u64)1E9 +
+		((u64)ru.ru_utime.tv_usec + (u64)ru.ru_stime.tv_usec) * 1000;
+}
+
+// cpu time of the calling thread
+static inline u64
+thread_cpu_ns(void)
+{
+	struct timespec ts;
+	CHECK(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+
+	return (u64)ts.tv_sec * (u64)1E9 + (u64)ts.tv_nsec;
+}
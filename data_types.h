@@ -16,6 +16,9 @@ typedef int64_t s64;
 typedef uint32_t u32;
 typedef int32_t s32;
 
+// gcc extension, used for intermediates of 64x64-bit multiplies
+typedef unsigned __int128 u128;
+
 // this relies on the fact that right shifting will replace the left
 // most bits to zero (gcc specific?)
 #define S64_MAX ((s64)(~0ULL>>1))
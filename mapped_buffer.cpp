@@ -0,0 +1,130 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+using namespace std;
+
+#include "mapped_buffer.h"
+#include "gcc_helpers/debug.h"
+
+// not in every libc's <sys/mman.h> (it is in <linux/mman.h>)
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+// hugetlb pages are asked for by size (MAP_HUGE_2MB), rather than whatever
+// the default hugepage size of the system is; also the x86 THP size
+static const size_t hugepage_size = (size_t)2 << 20;
+
+static size_t
+round_up(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+mapped_buffer::mapped_buffer()
+	: _addr(nullptr), _size(0), _pages(PAGES_NORMAL), _locked(false)
+{
+}
+
+mapped_buffer::~mapped_buffer()
+{
+	unmap();
+}
+
+void
+mapped_buffer::map(size_t size, const options &opts)
+{
+	unmap();
+
+	void *addr = MAP_FAILED;
+	page_mode pages = opts.pages;
+
+	if (pages == PAGES_HUGETLB) {
+		size = round_up(size, hugepage_size);
+		addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB | MAP_POPULATE, -1, 0);
+		if (addr == MAP_FAILED) {
+			cout << "no 2 MB hugetlb pages available (see "
+				"/sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages), "
+				"using transparent hugepages." << endl;
+			pages = PAGES_THP;
+		}
+	}
+
+	if (addr == MAP_FAILED) {
+		size = round_up(size, pages == PAGES_THP ? hugepage_size : (size_t)sysconf(_SC_PAGESIZE));
+		int populate = pages == PAGES_THP ? 0 : MAP_POPULATE;
+
+		addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+		if (addr == MAP_FAILED) {
+			cout << "unable to map " << size << " bytes, exiting." << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		if (pages == PAGES_THP) {
+			if (madvise(addr, size, MADV_HUGEPAGE))
+				cout << "transparent hugepages not available, using normal pages." << endl;
+
+			// fault in now, not in the measurement loop
+			memset(addr, 0, size);
+		}
+	}
+
+	_locked = false;
+	if (opts.lock) {
+		if (mlock(addr, size))
+			cout << "unable to lock " << size << " bytes in memory (RLIMIT_MEMLOCK?), continuing." << endl;
+		else
+			_locked = true;
+	}
+
+	_addr = addr;
+	_size = size;
+	_pages = pages;
+}
+
+void
+mapped_buffer::unmap()
+{
+	if (!_addr)
+		return;
+
+	// also unlocks
+	CHECK(munmap(_addr, _size));
+
+	_addr = nullptr;
+	_size = 0;
+	_locked = false;
+}
+
+bool
+mapped_buffer::parse_page_mode(const char *str, page_mode &mode)
+{
+	for (int m=PAGES_NORMAL; m<=PAGES_HUGETLB; ++m) {
+		if (!strcmp(str, page_mode_str((page_mode)m))) {
+			mode = (page_mode)m;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char *
+mapped_buffer::page_mode_str(page_mode mode)
+{
+	switch (mode) {
+	case PAGES_NORMAL:
+		return "normal";
+	case PAGES_THP:
+		return "thp";
+	case PAGES_HUGETLB:
+		return "hugetlb";
+	}
+
+	return "?";
+}
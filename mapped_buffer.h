@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Anonymous memory for buffers written inside measurement loops (e.g., the
+ * spsc_ring of every cpu_consumer thread).
+ *
+ * Unlike new, every page is faulted in by map() (MAP_POPULATE, or touched
+ * when transparent hugepages are requested, since MAP_POPULATE would fault in
+ * 4 KB pages before madvise() could ask for huge ones), so page faults do not
+ * show up as preemptions later.  The pages are allocated by (so, with the
+ * default numa policy, local to) the thread calling map().
+ *
+ * Optionally:
+ * 	- PAGES_THP: transparent hugepages (madvise(MADV_HUGEPAGE))
+ * 	- PAGES_HUGETLB: preallocated 2 MB hugepages (MAP_HUGETLB |
+ * 	  MAP_HUGE_2MB, see /sys/kernel/mm/hugepages/hugepages-2048kB), the
+ * 	  size is rounded up to a whole number of them.  Falls back to
+ * 	  PAGES_THP if none are free.
+ * 	- lock: mlock() the buffer, so it is never swapped out (needs
+ * 	  CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK, ignored otherwise)
+ */
+
+#include <stddef.h>
+
+class mapped_buffer {
+	public:
+		enum page_mode {
+			PAGES_NORMAL,
+			PAGES_THP,
+			PAGES_HUGETLB,
+		};
+
+		struct options {
+			page_mode pages;
+			bool lock;
+
+			options(page_mode p=PAGES_NORMAL, bool l=false) : pages(p), lock(l) {}
+		};
+
+		mapped_buffer();
+		~mapped_buffer();
+
+		mapped_buffer(const mapped_buffer &) = delete;
+		mapped_buffer &operator=(const mapped_buffer &) = delete;
+
+		// exits on failure
+		void map(size_t size, const options &opts=options());
+		void unmap(void);
+
+		void *get(void) const { return _addr; }
+		size_t size(void) const { return _size; }  // as mapped (rounded up)
+		page_mode pages(void) const { return _pages; }
+		bool locked(void) const { return _locked; }
+
+		// "normal", "thp" or "hugetlb", false if @str is none of them
+		static bool parse_page_mode(const char *str, page_mode &mode);
+		static const char *page_mode_str(page_mode mode);
+
+	private:
+		void *_addr;
+		size_t _size;
+		page_mode _pages;
+		bool _locked;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Fixed-point frequency conversion in the style of the linux kernel's
+ * clocksource (see clocks_calc_mult_shift() in kernel/time/clocksource.c).
+ *
+ * A conversion from a counter running at from_hz to one running at to_hz is
+ * precomputed as a (mult, shift) pair such that:
+ *
+ * 	to = (from * mult) >> shift
+ *
+ * The product is done with a 128-bit intermediate, so the full u64 input
+ * range can be converted without overflow of the intermediate.  shift is
+ * chosen as large as possible while mult still fits in 64 bits and mult is
+ * rounded to nearest.  That bounds the error of the unrounded product to less
+ * than 1 unit, so the result is within 1 of the exact floor(from * to_hz /
+ * from_hz) for every u64 input whose result is representable in 64 bits.
+ */
+
+#include "data_types.h"
+
+class mult_shift {
+	public:
+		u64 mult;
+		u32 shift;
+
+		mult_shift(void) : mult(0), shift(0) {}
+
+		static mult_shift calc(u64 from_hz, u64 to_hz);
+
+		// results that do not fit in a u64 are saturated
+		u64 convert(u64 val) const;
+
+		bool is_set(void) const { return 0 != mult; }
+};
+
+inline
+mult_shift mult_shift::calc(u64 from_hz, u64 to_hz)
+{
+	mult_shift rtn;
+
+	if (0 == from_hz || 0 == to_hz)
+		return rtn;
+
+	u32 to_bits = 64 - (u32)__builtin_clzll(to_hz);
+	u32 from_bits = 64 - (u32)__builtin_clzll(from_hz);
+
+	// start just above the largest shift that could possibly keep mult in 64
+	// bits, while leaving (to_hz << shift) + from_hz/2 room in 128 bits
+	u32 sft = 64 + from_bits - to_bits + 1;
+	if (sft > 127 - to_bits)
+		sft = 127 - to_bits;
+
+	// find the largest shift where mult still fits in 64 bits
+	for (;;) {
+		u128 tmp = ((u128)to_hz << sft) + (from_hz / 2);
+		tmp /= from_hz;
+
+		if (0 == (tmp >> 64)) {
+			rtn.mult = (u64)tmp;
+			rtn.shift = sft;
+			break;
+		}
+		--sft;
+	}
+
+	return rtn;
+}
+
+inline
+u64 mult_shift::convert(u64 val) const
+{
+	u128 rtn = ((u128)val * mult) >> shift;
+
+	if (rtn >> 64)
+		return ~0ULL;
+
+	return (u64)rtn;
+}
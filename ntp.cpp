@@ -31,17 +31,13 @@ int main(int, char* [])
 
 	cout << "now: " << now << endl;
 	cout << "ntp: " << ntp_time << endl;
-	time_unit diff(false);
-	if (now > ntp_time) {
-		cout << "difference: (setting time EARLIER by the following)" << endl;
-		diff = now - ntp_time;
-	} else {
+	// positive if the local clock is ahead
+	time_duration diff = now.diff(ntp_time);
+	if (diff.is_negative())
 		cout << "difference: (setting time LATER by the following)" << endl;
-		diff = ntp_time - now;
-	}
-	//cout << diff.get_seconds() << endl;
-	cout << "diff: " << endl;
-	print_ts(diff._timespec);
+	else
+		cout << "difference: (setting time EARLIER by the following)" << endl;
+	cout << "diff: " << diff.abs() << " (" << diff.get_seconds() << " secs)" << endl;
 
 	auto tv = ntp_time.get_timeval();
 	int rtn = settimeofday(&tv, NULL);
@@ -0,0 +1,147 @@
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <iostream>
+using namespace std;
+
+#include "gcc_helpers/debug.h"
+
+#include "periodic_timer.h"
+
+void
+periodic_timer::nanosleep_sleeper::sleep_until(u64 mono_ns)
+{
+	time_unit t(false);
+	t.set_nanosecs(mono_ns);
+
+	// restarted if interrupted by a signal
+	t.sleep_absolute(false);
+}
+
+void
+periodic_timer::precise_sleeper::sleep_until(u64 mono_ns)
+{
+	time_unit t(false);
+	t.set_nanosecs(mono_ns);
+
+	t.sleep_precise(false);
+}
+
+periodic_timer::timerfd_sleeper::timerfd_sleeper()
+{
+	_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (_fd < 0) {
+		cout << "unable to create timerfd, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+periodic_timer::timerfd_sleeper::~timerfd_sleeper()
+{
+	::close(_fd);
+}
+
+void
+periodic_timer::timerfd_sleeper::sleep_until(u64 mono_ns)
+{
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value = time_unit::nsec2ts(mono_ns);
+
+	// a time in the past expires immediately (it_value 0 would disarm)
+	if (!mono_ns)
+		its.it_value.tv_nsec = 1;
+
+	CHECK(timerfd_settime(_fd, TFD_TIMER_ABSTIME, &its, NULL));
+
+	// interrupted by a signal: returns early, wait() sleeps again
+	u64 expirations;
+	if (read(_fd, &expirations, sizeof(expirations)) < 0 && errno != EINTR) {
+		cout << "timerfd read failed, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+void
+periodic_timer::stats::reset()
+{
+	nr_releases = 0;
+	nr_overruns = 0;
+	nr_skipped = 0;
+	lateness.reset();
+}
+
+periodic_timer::periodic_timer(time_unit period, overrun_policy policy, sleeper *s)
+	: _period_ns(period.get_nanosecs()), _policy(policy),
+	_sleeper(s ? s : &_default_sleeper), _epoch_ns(0), _next(1)
+{
+	if (!_period_ns) {
+		cout << "periodic_timer: period must not be 0, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	_stats.reset();
+}
+
+u64
+periodic_timer::now_ns()
+{
+	return time_unit::NOW(false).get_nanosecs();
+}
+
+void
+periodic_timer::start()
+{
+	start(time_unit::NOW(false));
+}
+
+void
+periodic_timer::start(time_unit epoch)
+{
+	_epoch_ns = epoch.get_nanosecs();
+	_next = 1;
+	_stats.reset();
+}
+
+u64
+periodic_timer::wait()
+{
+	u64 release = release_ns(_next);
+	u64 now = now_ns();
+	u64 nr = 1;
+
+	if (now >= release) {
+		_stats.nr_overruns++;
+
+		// further releases that passed, besides _next
+		u64 behind = (now - release) / _period_ns;
+
+		switch (_policy) {
+		case OVERRUN_SKIP:
+			_stats.nr_skipped += behind + 1;
+			_next += behind + 1;
+			release = release_ns(_next);
+			break;
+		case OVERRUN_CATCH_UP:
+			break;
+		case OVERRUN_BURST:
+			nr += behind;
+			break;
+		}
+	}
+
+	while (now < release) {
+		_sleeper->sleep_until(release);
+		now = now_ns();
+	}
+
+	_stats.lateness.record(now - release);
+	_stats.nr_releases += nr;
+	_next += nr;
+
+	return nr;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Wakes a thread up periodically, for work that must run once per period.
+ *
+ * Release k is at epoch + k * period (computed, not accumulated), so an
+ * early/late wakeup or a rounding never shifts the following releases.
+ *
+ * wait() sleeps until the next release.  If the caller's work ran past one
+ * or more releases (an overrun), the overrun policy decides what happens to
+ * them:
+ *
+ * 	OVERRUN_SKIP     - the releases that passed are dropped, wait() sleeps
+ * 	                   until the next release in the future
+ * 	OVERRUN_CATCH_UP - wait() returns immediately, once for every release
+ * 	                   that passed, until the caller caught up
+ * 	OVERRUN_BURST    - wait() returns immediately, once, with the number
+ * 	                   of releases that passed (to be handled together)
+ *
+ * How the thread sleeps is up to a sleeper: clock_nanosleep()
+ * (nanosleep_sleeper, the default), sleep then spin (precise_sleeper, see
+ * time_unit::sleep_precise()) or a timerfd (timerfd_sleeper), or any other
+ * implementation.
+ *
+ * Lateness (wakeup - release) and overruns are recorded in stats.  Nothing is
+ * allocated per period.
+ *
+ * All times are CLOCK_MONOTONIC nsecs (timespec time_units).
+ */
+
+#include "data_types.h"
+#include "time_unit.h"
+#include "preempt_histogram.h"
+
+class periodic_timer {
+	public:
+		enum overrun_policy {
+			OVERRUN_SKIP,
+			OVERRUN_CATCH_UP,
+			OVERRUN_BURST,
+		};
+
+		class sleeper {
+			public:
+				virtual ~sleeper() {}
+
+				// until CLOCK_MONOTONIC @mono_ns (may return late, not early)
+				virtual void sleep_until(u64 mono_ns) = 0;
+		};
+
+		class nanosleep_sleeper : public sleeper {
+			public:
+				void sleep_until(u64 mono_ns);
+		};
+
+		class precise_sleeper : public sleeper {
+			public:
+				void sleep_until(u64 mono_ns);
+		};
+
+		class timerfd_sleeper : public sleeper {
+			public:
+				timerfd_sleeper();  // exits on failure
+				~timerfd_sleeper();
+
+				timerfd_sleeper(const timerfd_sleeper &) = delete;
+				timerfd_sleeper &operator=(const timerfd_sleeper &) = delete;
+
+				void sleep_until(u64 mono_ns);
+
+			private:
+				int _fd;
+		};
+
+		struct stats {
+			u64 nr_releases;        // returned by wait() (counting a burst's releases)
+			u64 nr_overruns;        // wait() called after the release it waits for
+			u64 nr_skipped;         // releases dropped (OVERRUN_SKIP)
+			preempt_histogram lateness;  // nsecs, per wait()
+
+			void reset(void);
+		};
+
+		// @s - nullptr for a nanosleep_sleeper, otherwise owned by the caller
+		explicit periodic_timer(time_unit period, overrun_policy policy=OVERRUN_SKIP,
+				sleeper *s=nullptr);
+
+		// first release one period after @epoch (default: now), resets the stats
+		void start(void);
+		void start(time_unit epoch);
+
+		// @return - number of releases handled by this wakeup (at least 1)
+		u64 wait(void);
+
+		u64 release_ns(u64 k) const { return _epoch_ns + k * _period_ns; }
+		u64 next_release_ns(void) const { return release_ns(_next); }
+
+		const stats &get_stats(void) const { return _stats; }
+
+	private:
+		static u64 now_ns(void);
+
+		const u64 _period_ns;
+		const overrun_policy _policy;
+		sleeper *_sleeper;
+		nanosleep_sleeper _default_sleeper;
+
+		u64 _epoch_ns;
+		u64 _next;  // index of the next release
+		stats _stats;
+};
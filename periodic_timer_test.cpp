@@ -0,0 +1,154 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+#include <cstring>
+
+#include <iostream>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "periodic_timer.h"
+
+/**
+ * DESCRIPTION:
+ * Runs a periodic_timer with every sleeper and overrun policy, with an
+ * overrun of 3.5 periods every 50 periods, and prints the lateness and
+ * overrun counts.
+ *
+ * Checks that the releases did not drift, from the wakeups themselves: the
+ * time wait() returned at (not the timer's own lateness) minus the release it
+ * handled on the grid epoch + index * period, for every wakeup that was not
+ * an overrun.  That lateness must never be negative, its p90 must stay below
+ * max_lateness_ns and the median of the second half of the run must not
+ * exceed the first half's by more than max_growth_ns (a drift of 0.5 usecs
+ * per period, at the default 500 periods).  Percentiles rather than means and
+ * maxima, so that a few preemptions of the test do not fail it.
+ *
+ * usage: periodic_timer_test [period usecs (default 1000)] [periods (default 500)]
+ */
+
+static const u64 overrun_every = 50;
+
+// loose enough for a loaded VM, far below a period of drift
+static const u64 max_lateness_ns = 1000 * 1000;
+static const u64 max_growth_ns = 125 * 1000;
+
+static bool
+run(const char *name, periodic_timer::sleeper &s, periodic_timer::overrun_policy policy,
+	const char *policy_name, u64 period_ns, u64 nr_periods)
+{
+	periodic_timer timer(time_unit::NANOSECS(period_ns), policy, &s);
+	timer.start();
+
+	const periodic_timer::stats &st = timer.get_stats();
+	u64 epoch_ns = timer.release_ns(0);
+	u64 nr_wakeups = 0;
+
+	// lateness (test's clock) of the wakeups that slept, by release index
+	vector<pair<u64, s64>> lateness;
+	lateness.reserve(nr_periods);
+
+	while (st.nr_releases + st.nr_skipped < nr_periods) {
+		u64 nr_overruns = st.nr_overruns;
+		u64 nr = timer.wait();
+		s64 now_ns = (s64)time_unit::NOW(false).get_nanosecs();
+
+		if (nr == 1 && st.nr_overruns == nr_overruns) {
+			u64 index = st.nr_releases + st.nr_skipped;
+			lateness.emplace_back(index, now_ns - (s64)(epoch_ns + index * period_ns));
+		}
+
+		// simulated work that runs too long
+		if (++nr_wakeups % overrun_every == 0) {
+			time_unit end = time_unit::NOW(false);
+			end.add_ns(period_ns * 7 / 2);
+			while (!(time_unit::NOW(false) >= end))
+				;
+		}
+	}
+
+	preempt_histogram measured;
+	preempt_histogram halves[2];
+	bool early = false;
+
+	for (const auto &l : lateness) {
+		if (l.second < 0) {
+			early = true;
+			continue;
+		}
+		measured.record((u64)l.second);
+
+		halves[l.first * 2 > nr_periods].record((u64)l.second);
+	}
+
+	s64 growth = 0;
+	if (halves[0].count() && halves[1].count())
+		growth = (s64)halves[1].percentile(50) - (s64)halves[0].percentile(50);
+
+	const char *result = "ok";
+	if (early || lateness.empty())
+		result = "EARLY";
+	else if (measured.percentile(90) > max_lateness_ns)
+		result = "LATE";
+	else if (growth > (s64)max_growth_ns)
+		result = "DRIFTED";
+
+	printf("%-9s %-8s wakeups %5llu releases %5llu overruns %3llu skipped %4llu"
+		"  lateness p50 %7llu p99 %8llu max %8llu  measured p90 %8llu growth %8lld  %s\n",
+		name, policy_name,
+		(unsigned long long)nr_wakeups,
+		(unsigned long long)st.nr_releases,
+		(unsigned long long)st.nr_overruns,
+		(unsigned long long)st.nr_skipped,
+		(unsigned long long)st.lateness.percentile(50),
+		(unsigned long long)st.lateness.percentile(99),
+		(unsigned long long)st.lateness.max(),
+		(unsigned long long)measured.percentile(90), (long long)growth,
+		result);
+
+	return !strcmp(result, "ok");
+}
+
+int main(int argc, char *argv[])
+{
+	u64 period_ns = (argc > 1 ? strtoull(argv[1], NULL, 0) : 1000) * 1000;
+	u64 nr_periods = argc > 2 ? strtoull(argv[2], NULL, 0) : 500;
+
+	if (!period_ns || !nr_periods) {
+		cout << "usage: " << argv[0] << " [period usecs] [periods]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	periodic_timer::nanosleep_sleeper nanosleep_s;
+	periodic_timer::precise_sleeper precise_s;
+	periodic_timer::timerfd_sleeper timerfd_s;
+
+	struct {
+		const char *name;
+		periodic_timer::sleeper *s;
+	} sleepers[] = {
+		{ "nanosleep", &nanosleep_s },
+		{ "precise", &precise_s },
+		{ "timerfd", &timerfd_s },
+	};
+
+	struct {
+		const char *name;
+		periodic_timer::overrun_policy policy;
+	} policies[] = {
+		{ "skip", periodic_timer::OVERRUN_SKIP },
+		{ "catch_up", periodic_timer::OVERRUN_CATCH_UP },
+		{ "burst", periodic_timer::OVERRUN_BURST },
+	};
+
+	cout << "lateness in nsecs, period " << period_ns / 1000 << " usecs" << endl;
+
+	bool ok = true;
+	for (const auto &s : sleepers) {
+		for (const auto &p : policies)
+			ok &= run(s.name, *s.s, p.policy, p.name, period_ns, nr_periods);
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
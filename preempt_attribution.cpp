@@ -0,0 +1,332 @@
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "x86_tsc.h"
+
+#include "preempt_attribution.h"
+
+// MSR_SMI_COUNT (Intel SDM vol. 4), bits 31:0
+constexpr off_t msr_smi_count = 0x34;
+
+void
+preempt_attribution::result::reset()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+void
+preempt_attribution::result::merge(const result &other)
+{
+	counts.ctxsw += other.counts.ctxsw;
+	counts.smis += other.counts.smis;
+	counts.hard_irqs += other.counts.hard_irqs;
+	counts.softirqs += other.counts.softirqs;
+	have_smis = have_smis || other.have_smis;
+
+	for (int i=0; i<NR_CAUSES; ++i) {
+		gaps[i] += other.gaps[i];
+		cycles[i] += other.cycles[i];
+	}
+	overhead_cycles += other.overhead_cycles;
+}
+
+preempt_attribution::preempt_attribution()
+	: _cpu(-1), _interrupts_fd(-1), _softirqs_fd(-1), _status_fd(-1), _msr_fd(-1),
+	_interrupts_col(-1), _softirqs_col(-1)
+{
+	memset(&_trial_start, 0, sizeof(_trial_start));
+	memset(&_last, 0, sizeof(_last));
+	_result.reset();
+}
+
+preempt_attribution::~preempt_attribution()
+{
+	close();
+}
+
+const char *
+preempt_attribution::cause_str(cause_t cause)
+{
+	switch (cause) {
+		case CAUSE_CTXSW:    return "ctxsw";
+		case CAUSE_SMI:      return "smi";
+		case CAUSE_HARD_IRQ: return "hard_irq";
+		case CAUSE_SOFTIRQ:  return "softirq";
+		default:             return "unknown";
+	}
+}
+
+/**
+ * Read all of @fd (from the start) into _buf.
+ */
+bool
+preempt_attribution::read_file(int fd)
+{
+	size_t len = 0;
+
+	for (;;) {
+		if (_buf.size() - len < 4096)
+			_buf.resize(_buf.size() * 2 + 4096);
+
+		ssize_t rtn = pread(fd, &_buf[len], _buf.size() - len - 1, (off_t)len);
+		if (rtn < 0) {
+			if (EINTR == errno)
+				continue;
+			return false;
+		}
+		if (0 == rtn)
+			break;
+		len += (size_t)rtn;
+	}
+
+	_buf[len] = '\0';
+
+	return true;
+}
+
+/**
+ * @return - column (0 based) of @cpu in the "CPU0 CPU1 ..." header line of
+ * /proc/interrupts or /proc/softirqs (in @buf), -1 if not found
+ */
+static int
+find_column(const char *buf, int cpu)
+{
+	int col = 0;
+	const char *p = buf;
+
+	while (*p && *p != '\n') {
+		while (' ' == *p)
+			++p;
+		if (strncmp(p, "CPU", 3))
+			break;
+
+		char *end;
+		long id = strtol(p + 3, &end, 10);
+		if (id == cpu)
+			return col;
+
+		p = end;
+		++col;
+	}
+
+	return -1;
+}
+
+/**
+ * @return - number of "CPUn" columns in the header line (in @buf)
+ */
+static int
+nr_columns(const char *buf)
+{
+	int nr = 0;
+	const char *eol = strchr(buf, '\n');
+
+	for (const char *p = buf; (p = strstr(p, "CPU")) && (!eol || p < eol); p += 3)
+		++nr;
+
+	return nr;
+}
+
+/**
+ * @return - sum of column @column over all per cpu lines (but the header) of
+ * @fd.  Lines with fewer values than cpus (e.g., "ERR:" and "MIS:" of
+ * /proc/interrupts) are system wide counters and are skipped, as are "ERR:"
+ * and "MIS:" on a 1 cpu host (where they look per cpu).
+ */
+u64
+preempt_attribution::read_proc_column(int fd, int column)
+{
+	if (fd < 0 || column < 0 || !read_file(fd))
+		return 0;
+
+	const int nr_cpus = nr_columns(_buf.c_str());
+
+	u64 sum = 0;
+	const char *p = strchr(_buf.c_str(), '\n');
+
+	while (p && *++p) {
+		// skip the "NAME:" label
+		const char *colon = strchr(p, ':');
+		const char *eol = strchr(p, '\n');
+		if (!colon || (eol && colon > eol))
+			break;
+		// system wide, even when they happen to have as many values as cpus
+		bool per_cpu = colon - p < 3 ||
+			(strncmp(colon - 3, "ERR", 3) && strncmp(colon - 3, "MIS", 3));
+		p = colon + 1;
+
+		int nr = 0;
+		u64 val = 0;
+		for (;; ++nr) {
+			while (' ' == *p)
+				++p;
+			if (*p < '0' || *p > '9')
+				break;
+
+			char *end;
+			u64 v = strtoull(p, &end, 10);
+			if (nr == column)
+				val = v;
+			p = end;
+		}
+
+		if (per_cpu && nr >= nr_cpus)
+			sum += val;
+
+		p = strchr(p, '\n');
+	}
+
+	return sum;
+}
+
+u64
+preempt_attribution::read_ctxsw()
+{
+	if (_status_fd < 0 || !read_file(_status_fd))
+		return 0;
+
+	// voluntary_ctxt_switches and nonvoluntary_ctxt_switches
+	u64 sum = 0;
+	const char *p = _buf.c_str();
+	while ((p = strstr(p, "ctxt_switches:"))) {
+		char *end;
+		sum += strtoull(p + strlen("ctxt_switches:"), &end, 10);
+		p = end;
+	}
+
+	return sum;
+}
+
+u64
+preempt_attribution::read_smis()
+{
+	u64 val;
+
+	if (_msr_fd < 0 || pread(_msr_fd, &val, sizeof(val), msr_smi_count) != sizeof(val))
+		return 0;
+
+	return val & 0xffffffffULL;
+}
+
+bool
+preempt_attribution::open(int cpu)
+{
+	close();
+	_cpu = cpu;
+
+	_interrupts_fd = ::open("/proc/interrupts", O_RDONLY | O_CLOEXEC);
+	if (_interrupts_fd >= 0 && read_file(_interrupts_fd))
+		_interrupts_col = find_column(_buf.c_str(), cpu);
+
+	_softirqs_fd = ::open("/proc/softirqs", O_RDONLY | O_CLOEXEC);
+	if (_softirqs_fd >= 0 && read_file(_softirqs_fd))
+		_softirqs_col = find_column(_buf.c_str(), cpu);
+
+	string status = "/proc/self/task/" + to_string(syscall(SYS_gettid)) + "/status";
+	_status_fd = ::open(status.c_str(), O_RDONLY | O_CLOEXEC);
+
+	string msr = "/dev/cpu/" + to_string(cpu) + "/msr";
+	_msr_fd = ::open(msr.c_str(), O_RDONLY | O_CLOEXEC);
+	if (_msr_fd >= 0) {
+		u64 val;
+		// not every cpu has MSR_SMI_COUNT
+		if (pread(_msr_fd, &val, sizeof(val), msr_smi_count) != sizeof(val)) {
+			::close(_msr_fd);
+			_msr_fd = -1;
+		}
+	}
+
+	if (_interrupts_col < 0 || _softirqs_col < 0 || _status_fd < 0) {
+		cout << "unable to read interrupt counters of cpu " << cpu << endl;
+		return false;
+	}
+
+	return true;
+}
+
+void
+preempt_attribution::close()
+{
+	for (int *fd : {&_interrupts_fd, &_softirqs_fd, &_status_fd, &_msr_fd}) {
+		if (*fd >= 0)
+			::close(*fd);
+		*fd = -1;
+	}
+
+	_interrupts_col = _softirqs_col = -1;
+}
+
+void
+preempt_attribution::read(counters &c)
+{
+	c.ctxsw = read_ctxsw();
+	c.smis = read_smis();
+	c.hard_irqs = read_proc_column(_interrupts_fd, _interrupts_col);
+	c.softirqs = read_proc_column(_softirqs_fd, _softirqs_col);
+}
+
+preempt_attribution::cause_t
+preempt_attribution::classify(const counters &before, const counters &after)
+{
+	if (after.ctxsw != before.ctxsw)
+		return CAUSE_CTXSW;
+	if (after.smis != before.smis)
+		return CAUSE_SMI;
+	if (after.hard_irqs != before.hard_irqs)
+		return CAUSE_HARD_IRQ;
+	if (after.softirqs != before.softirqs)
+		return CAUSE_SOFTIRQ;
+
+	return CAUSE_UNKNOWN;
+}
+
+void
+preempt_attribution::trial_begin()
+{
+	_result.reset();
+	_result.have_smis = _msr_fd >= 0;
+
+	read(_trial_start);
+	_last = _trial_start;
+}
+
+void
+preempt_attribution::trial_end()
+{
+	counters end;
+	read(end);
+
+	_result.counts.ctxsw = end.ctxsw - _trial_start.ctxsw;
+	_result.counts.smis = end.smis - _trial_start.smis;
+	_result.counts.hard_irqs = end.hard_irqs - _trial_start.hard_irqs;
+	_result.counts.softirqs = end.softirqs - _trial_start.softirqs;
+}
+
+u64
+preempt_attribution::gap(u64 gap_cycles)
+{
+	u64 start = read_tsc();
+
+	counters now;
+	read(now);
+
+	cause_t cause = classify(_last, now);
+	_result.gaps[cause]++;
+	_result.cycles[cause] += gap_cycles;
+	_last = now;
+
+	// the reading itself may have been interrupted, those counts belong
+	// to the next gap
+	u64 end = read_tsc();
+	_result.overhead_cycles += end - start;
+
+	return end;
+}
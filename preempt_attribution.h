@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Explains where the time a pinned thread (see cpu_consumer.h) lost to
+ * preemptions went, from the counters the kernel and cpu keep:
+ *
+ * 	- context switches of the thread (/proc/self/task/<tid>/status)
+ * 	- SMIs of the cpu (MSR_SMI_COUNT, needs the msr module and root)
+ * 	- hard IRQs of the cpu (/proc/interrupts)
+ * 	- softirqs of the cpu (/proc/softirqs)
+ *
+ * Reading them takes several usecs (more on hosts with many cpus), so by
+ * default they are only read before and after a trial (counts only).  In
+ * per gap mode they are read after every preemption and the preemption's
+ * length is attributed to the most disruptive counter that changed, in the
+ * order above (an IRQ usually raises a softirq, a context switch usually
+ * follows an IRQ).  A preemption with no counter change is "unknown" (e.g.,
+ * a hypervisor running another vcpu).
+ *
+ * A preempt_attribution must be opened and used by the thread it measures.
+ */
+
+#include <string>
+
+#include "data_types.h"
+
+class preempt_attribution {
+	public:
+		enum cause_t {
+			CAUSE_CTXSW,
+			CAUSE_SMI,
+			CAUSE_HARD_IRQ,
+			CAUSE_SOFTIRQ,
+			CAUSE_UNKNOWN,
+			NR_CAUSES,
+		};
+
+		struct counters {
+			u64 ctxsw;
+			u64 smis;
+			u64 hard_irqs;
+			u64 softirqs;
+		};
+
+		struct result {
+			counters counts;          // counter increments over the trial
+			bool have_smis;           // MSR_SMI_COUNT was readable
+
+			// per gap mode only
+			u64 gaps[NR_CAUSES];
+			u64 cycles[NR_CAUSES];
+			u64 overhead_cycles;      // spent reading the counters
+
+			void reset(void);
+			void merge(const result &other);
+		};
+
+		preempt_attribution();
+		~preempt_attribution();
+
+		preempt_attribution(const preempt_attribution &) = delete;
+		preempt_attribution &operator=(const preempt_attribution &) = delete;
+
+		// @cpu - the cpu the calling thread is pinned to
+		bool open(int cpu);
+		void close(void);
+
+		void read(counters &c);
+
+		// around a trial
+		void trial_begin(void);
+		void trial_end(void);
+
+		/*
+		 * Per gap mode, right after a preemption of @gap_cycles.  Reads the
+		 * counters and attributes the gap.  @return - TSC after reading
+		 * (so the caller does not count the reading as execution or as
+		 * another gap).
+		 */
+		u64 gap(u64 gap_cycles);
+
+		const result &get_result(void) const { return _result; }
+
+		static const char *cause_str(cause_t cause);
+		static cause_t classify(const counters &before, const counters &after);
+
+	private:
+		bool read_file(int fd);
+		u64 read_proc_column(int fd, int column);
+		u64 read_ctxsw(void);
+		u64 read_smis(void);
+
+		int _cpu;
+		int _interrupts_fd;
+		int _softirqs_fd;
+		int _status_fd;
+		int _msr_fd;
+
+		// column of _cpu in /proc/interrupts and /proc/softirqs
+		int _interrupts_col;
+		int _softirqs_col;
+
+		// reused for every read, nothing is allocated while measuring
+		std::string _buf;
+
+		counters _trial_start;
+		counters _last;
+		result _result;
+};
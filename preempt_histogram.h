@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Log-linear (HDR style) histogram of u64 values, e.g., preemption lengths in
+ * cycles (see cpu_consumer.h).
+ *
+ * Values below 2^(sub_bits+1) each get their own bucket.  Above that, every
+ * power of 2 is split into 2^sub_bits equally sized buckets, so a bucket is
+ * never wider than 1/2^sub_bits (~3%) of the values it holds.  The whole u64
+ * range fits in a fixed array (~15 KB), nothing is allocated.
+ *
+ * record() is a count leading zeros, a shift and a few adds, no branches
+ * (besides what the compiler makes of max()).
+ *
+ * percentile() returns the highest value that falls in the same bucket as the
+ * requested percentile (but never more than max()).
+ */
+
+#include <string.h>
+
+#include "data_types.h"
+
+class preempt_histogram {
+	public:
+		static constexpr u32 sub_bits = 5;
+		static constexpr size_t nr_buckets = (size_t)(65 - sub_bits) << sub_bits;
+
+		preempt_histogram() { reset(); }
+
+		void reset(void);
+		void record(u64 val);
+		void merge(const preempt_histogram &other);
+
+		u64 count(void) const { return _count; }
+		u64 total(void) const { return _total; }  // sum of all values (wraps)
+		u64 max(void) const { return _max; }
+		u64 min(void) const;
+
+		// @p - 0 - 100
+		u64 percentile(double p) const;
+
+		u64 bucket_count(size_t idx) const { return _buckets[idx]; }
+
+		static size_t bucket(u64 val);
+		static u64 bucket_lowest(size_t idx);
+		static u64 bucket_highest(size_t idx);
+
+	private:
+		u64 _count;
+		u64 _total;
+		u64 _max;
+		u64 _buckets[nr_buckets];
+};
+
+/**
+ * inline functions (must be put in header)
+ * https://isocpp.org/wiki/faq/inline-functions
+ */
+
+inline
+size_t preempt_histogram::bucket(u64 val)
+{
+	// position of the highest set bit (0 for val 0 and 1)
+	u32 msb = 63 - (u32)__builtin_clzll(val | 1);
+	u32 shift = msb > sub_bits ? msb - sub_bits : 0;
+
+	return ((size_t)shift << sub_bits) + (size_t)(val >> shift);
+}
+
+inline
+u64 preempt_histogram::bucket_lowest(size_t idx)
+{
+	u32 hi = (u32)(idx >> sub_bits);
+	u32 shift = hi > 1 ? hi - 1 : 0;
+
+	return (u64)(idx - ((size_t)shift << sub_bits)) << shift;
+}
+
+inline
+u64 preempt_histogram::bucket_highest(size_t idx)
+{
+	u32 hi = (u32)(idx >> sub_bits);
+	u32 shift = hi > 1 ? hi - 1 : 0;
+
+	// computed from the lowest value, the last bucket ends at u64 max
+	return bucket_lowest(idx) + ((1ULL << shift) - 1);
+}
+
+inline
+void preempt_histogram::reset()
+{
+	_count = 0;
+	_total = 0;
+	_max = 0;
+	memset(_buckets, 0, sizeof(_buckets));
+}
+
+inline
+void preempt_histogram::record(u64 val)
+{
+	_buckets[bucket(val)]++;
+	_count++;
+	_total += val;
+	_max = val > _max ? val : _max;
+}
+
+inline
+void preempt_histogram::merge(const preempt_histogram &other)
+{
+	for (size_t i=0; i<nr_buckets; ++i)
+		_buckets[i] += other._buckets[i];
+
+	_count += other._count;
+	_total += other._total;
+	if (other._max > _max)
+		_max = other._max;
+}
+
+inline
+u64 preempt_histogram::min() const
+{
+	for (size_t i=0; i<nr_buckets; ++i) {
+		if (_buckets[i])
+			return bucket_lowest(i);
+	}
+
+	return 0;
+}
+
+inline
+u64 preempt_histogram::percentile(double p) const
+{
+	if (!_count)
+		return 0;
+
+	// number of values at or below the percentile, at least one
+	u64 rank = (u64)(p / 100.0 * (double)_count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > _count)
+		rank = _count;
+
+	u64 seen = 0;
+	for (size_t i=0; i<nr_buckets; ++i) {
+		seen += _buckets[i];
+		if (seen >= rank) {
+			u64 highest = bucket_highest(i);
+			return highest < _max ? highest : _max;
+		}
+	}
+
+	return _max;
+}
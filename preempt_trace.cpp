@@ -0,0 +1,206 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "x86_tsc.h"
+#include "clock_params.h"
+#include "gcc_helpers/debug.h"
+
+#include "preempt_trace.h"
+
+static_assert(sizeof(preempt_trace::header) == 56, "preempt_trace::header layout changed, bump VERSION");
+
+preempt_trace_writer::preempt_trace_writer()
+	: _fd(-1), _ok(false), _prev_end(0), _len(0), _buf(nullptr)
+{
+}
+
+preempt_trace_writer::~preempt_trace_writer()
+{
+	close();
+}
+
+bool
+preempt_trace_writer::open(const string &path, int cpu)
+{
+	close();
+
+	_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (_fd < 0) {
+		cout << "unable to create " << path << endl;
+		return false;
+	}
+
+	if (!_buf)
+		_buf = new unsigned char[buf_size];
+
+	clock_params::snapshot snap;
+	clock_params::read(snap);
+
+	preempt_trace::header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = preempt_trace::MAGIC;
+	hdr.version = preempt_trace::VERSION;
+	hdr.size = sizeof(hdr);
+	hdr.cpu = cpu;
+	hdr.hz = snap.hz;
+	hdr.cyc2ns_mult = snap.cyc2ns.mult;
+	hdr.cyc2ns_shift = snap.cyc2ns.shift;
+
+	// TSC taken in the middle of the CLOCK_REALTIME read
+	struct timespec ts;
+	u64 before = read_tsc<tsc_read::lfence>();
+	CHECK(clock_gettime(CLOCK_REALTIME, &ts));
+	u64 after = read_tsc<tsc_read::lfence>();
+	hdr.anchor_tsc = before + (after - before) / 2;
+	hdr.anchor_realtime_ns = (u64)ts.tv_sec * (u64)1E9 + (u64)ts.tv_nsec;
+
+	memcpy(_buf, &hdr, sizeof(hdr));
+	_len = sizeof(hdr);
+	_prev_end = hdr.anchor_tsc;
+	_ok = true;
+
+	return true;
+}
+
+void
+preempt_trace_writer::flush()
+{
+	size_t done = 0;
+
+	while (done < _len) {
+		ssize_t rtn = write(_fd, _buf + done, _len - done);
+		if (rtn < 0) {
+			if (EINTR == errno)
+				continue;
+			// keep going (and dropping data), close() reports it
+			_ok = false;
+			break;
+		}
+		done += (size_t)rtn;
+	}
+
+	_len = 0;
+}
+
+bool
+preempt_trace_writer::close()
+{
+	if (_fd < 0)
+		return true;
+
+	flush();
+	if (::close(_fd))
+		_ok = false;
+	_fd = -1;
+
+	delete[] _buf;
+	_buf = nullptr;
+
+	return _ok;
+}
+
+preempt_trace_reader::preempt_trace_reader()
+	: _map(nullptr), _map_len(0), _pos(nullptr), _prev_end(0)
+{
+	memset(&_header, 0, sizeof(_header));
+}
+
+preempt_trace_reader::~preempt_trace_reader()
+{
+	close();
+}
+
+bool
+preempt_trace_reader::open(const string &path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		cout << "unable to open " << path << endl;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(preempt_trace::header)) {
+		cout << path << " is not a preemption trace." << endl;
+		::close(fd);
+		return false;
+	}
+
+	void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (MAP_FAILED == addr) {
+		cout << "unable to map " << path << endl;
+		return false;
+	}
+	madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	_map = (const unsigned char *)addr;
+	_map_len = (size_t)st.st_size;
+	memcpy(&_header, _map, sizeof(_header));
+
+	if (_header.magic != preempt_trace::MAGIC || _header.version != preempt_trace::VERSION
+			|| _header.size < sizeof(_header) || _header.size > _map_len) {
+		cout << path << " is not a (supported) preemption trace." << endl;
+		close();
+		return false;
+	}
+
+	_pos = _map + _header.size;
+	_prev_end = _header.anchor_tsc;
+
+	return true;
+}
+
+const preempt_trace::header &
+preempt_trace_reader::get_header() const
+{
+	return _header;
+}
+
+bool
+preempt_trace_reader::next(u64 &start, u64 &end)
+{
+	const unsigned char *map_end = _map + _map_len;
+	u64 gap, len;
+
+	if (!_pos || _pos == map_end)
+		return false;
+
+	const unsigned char *pos = preempt_trace::get_varint(_pos, map_end, gap);
+	if (pos)
+		pos = preempt_trace::get_varint(pos, map_end, len);
+	if (!pos) {
+		cout << "truncated preemption trace." << endl;
+		_pos = nullptr;
+		return false;
+	}
+
+	_pos = pos;
+	start = _prev_end + gap;
+	end = start + len;
+	_prev_end = end;
+
+	return true;
+}
+
+void
+preempt_trace_reader::close()
+{
+	if (_map)
+		munmap((void *)_map, _map_len);
+
+	_map = nullptr;
+	_map_len = 0;
+	_pos = nullptr;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Binary file format for recorded preemption intervals (see cpu_consumer.h),
+ * one file per cpu.
+ *
+ * The file starts with a header (preempt_trace::header) holding what is
+ * needed to interpret the TSC values: cpu_hz, the cycles -> nsecs mult/shift
+ * (see clock_params.h), the cpu, and a TSC value with the CLOCK_REALTIME
+ * time it was taken at.
+ *
+ * Each interval then follows as two unsigned LEB128 varints:
+ *
+ * 	start - end of the previous interval (TSC value of the anchor for the
+ * 	        first interval)
+ * 	end - start
+ *
+ * Both are usually small (a few bytes each instead of 16 bytes per
+ * interval in binary, or ~30 bytes as text).
+ *
+ * The writer encodes straight into a large buffer that is handed to write(),
+ * the reader decodes straight from a mmap of the file.
+ *
+ * preempt_trace_dump converts a trace to the old preempt_pts.dat text format.
+ */
+
+#include <string>
+
+#include "data_types.h"
+
+class preempt_trace {
+	public:
+		static const u32 MAGIC = 0x50545243; // "PTRC"
+		static const u32 VERSION = 1;
+
+		struct header {
+			u32 magic;
+			u32 version;
+			u32 size;             // sizeof(header), for later extensions
+			s32 cpu;
+			double hz;
+			u64 cyc2ns_mult;
+			u32 cyc2ns_shift;
+			u32 reserved;
+			u64 anchor_tsc;
+			u64 anchor_realtime_ns;
+		};
+
+		// LEB128 encoding of a u64 takes up to 10 bytes
+		static constexpr size_t max_varint_size = 10;
+
+		static size_t put_varint(unsigned char *out, u64 val);
+		static const unsigned char *get_varint(const unsigned char *in,
+				const unsigned char *end, u64 &val);
+
+	private:
+		preempt_trace();
+};
+
+class preempt_trace_writer {
+	public:
+		preempt_trace_writer();
+		~preempt_trace_writer();
+
+		preempt_trace_writer(const preempt_trace_writer &) = delete;
+		preempt_trace_writer &operator=(const preempt_trace_writer &) = delete;
+
+		// creates @path and writes the header (needs cpu_hz initialized)
+		bool open(const std::string &path, int cpu);
+
+		// @start/@end - TSC values, in increasing order
+		void append(u64 start, u64 end);
+
+		// @return - false if any write failed
+		bool close(void);
+
+	private:
+		static constexpr size_t buf_size = (size_t)1 << 20;
+
+		void flush(void);
+
+		int _fd;
+		bool _ok;
+		u64 _prev_end;
+		size_t _len;
+		unsigned char *_buf;
+};
+
+class preempt_trace_reader {
+	public:
+		preempt_trace_reader();
+		~preempt_trace_reader();
+
+		preempt_trace_reader(const preempt_trace_reader &) = delete;
+		preempt_trace_reader &operator=(const preempt_trace_reader &) = delete;
+
+		// @return - false if @path is not a (supported) trace
+		bool open(const std::string &path);
+		const preempt_trace::header &get_header(void) const;
+
+		// @return - false at the end of the trace (or if it is truncated)
+		bool next(u64 &start, u64 &end);
+
+		void close(void);
+
+	private:
+		const unsigned char *_map;
+		size_t _map_len;
+		const unsigned char *_pos;
+		u64 _prev_end;
+		preempt_trace::header _header;
+};
+
+/**
+ * inline functions (must be put in header)
+ * https://isocpp.org/wiki/faq/inline-functions
+ */
+
+/**
+ * @return - number of bytes written to @out (at most max_varint_size)
+ */
+inline
+size_t preempt_trace::put_varint(unsigned char *out, u64 val)
+{
+	size_t len = 0;
+
+	while (val >= 0x80) {
+		out[len++] = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	out[len++] = (unsigned char)val;
+
+	return len;
+}
+
+/**
+ * @return - position after the varint, nullptr if it does not end before @end
+ */
+inline
+const unsigned char *preempt_trace::get_varint(const unsigned char *in,
+		const unsigned char *end, u64 &val)
+{
+	val = 0;
+
+	for (u32 shift=0; in < end && shift < 64; shift += 7) {
+		unsigned char byte = *in++;
+		val |= (u64)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return in;
+	}
+
+	return nullptr;
+}
+
+inline
+void preempt_trace_writer::append(u64 start, u64 end)
+{
+	if (__builtin_expect(_len > buf_size - 2 * preempt_trace::max_varint_size, 0))
+		flush();
+
+	_len += preempt_trace::put_varint(_buf + _len, start - _prev_end);
+	_len += preempt_trace::put_varint(_buf + _len, end - start);
+	_prev_end = end;
+}
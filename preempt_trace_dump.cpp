@@ -0,0 +1,52 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "preempt_trace.h"
+
+/**
+ * DESCRIPTION:
+ * Converts a binary preemption trace (see preempt_trace.h) to the legacy
+ * preempt_pts.dat text format: "# <cpu_hz>", then the start and end TSC
+ * value of every preemption, one per line.
+ *
+ * usage: preempt_trace_dump <trace> [output (default: stdout)]
+ */
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		cout << "usage: " << argv[0] << " <trace> [output]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	preempt_trace_reader reader;
+	if (!reader.open(argv[1]))
+		return EXIT_FAILURE;
+
+	FILE *out = stdout;
+	if (argc > 2) {
+		out = fopen(argv[2], "w");
+		if (!out) {
+			cout << "unable to create " << argv[2] << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// stdio buffers, unlike the endl of the old writer
+	fprintf(out, "# %llu\n", (unsigned long long)reader.get_header().hz);
+
+	u64 start, end;
+	while (reader.next(start, end))
+		fprintf(out, "%llu\n%llu\n", (unsigned long long)start, (unsigned long long)end);
+
+	if (fclose(out)) {
+		cout << "error writing output" << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+#include <unistd.h>
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "preempt_trace.h"
+
+/**
+ * DESCRIPTION:
+ * Round trip of preemption traces (see preempt_trace.h): writes known
+ * intervals with preempt_trace_writer and checks that preempt_trace_reader
+ * returns exactly them, then times writing and reading synthetic intervals.
+ *
+ * The known intervals include
+ *
+ * 	- one that started before the writer's open() took its anchor (as the
+ * 	  drain thread of cpu_consumer may record), whose gap wraps to a 10
+ * 	  byte varint
+ * 	- gaps and lengths at every varint size boundary (0, 2^7 - 1, 2^7,
+ * 	  ..., 2^63)
+ * 	- enough random ones to flush the writer's buffer several times
+ *
+ * The synthetic intervals have gaps of up to 2^20 cycles and lengths of up
+ * to 2^14 cycles (about 5 bytes per interval).
+ *
+ * usage: preempt_trace_test [intervals to time (default 10000000)] [trace path]
+ */
+
+static const u64 nr_random = 1000 * 1000;
+
+static bool
+check(const char *what, bool ok)
+{
+	printf("%-42s %s\n", what, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static bool
+round_trip(const string &path)
+{
+	vector<pair<u64, u64>> intervals;
+
+	// starts before the anchor open() takes
+	u64 early = read_tsc<tsc_read::lfence>();
+
+	preempt_trace_writer writer;
+	if (!writer.open(path, 0))
+		return false;
+
+	intervals.emplace_back(early, early + 100);
+
+	u64 t = early + 100;
+	for (u32 bits=0; bits<=63; bits+=7) {
+		u64 vals[] = { bits ? ((u64)1 << bits) - 1 : 0, (u64)1 << bits };
+		for (u64 v : vals) {
+			// the same value as a gap and as a length
+			u64 start = t + v;
+			u64 end = start + v;
+			intervals.emplace_back(start, end);
+			t = end;
+		}
+	}
+
+	mt19937_64 rng(1);
+	uniform_int_distribution<u64> dist(0, (u64)1 << 20);
+	for (u64 i=0; i<nr_random; ++i) {
+		u64 start = t + dist(rng);
+		u64 end = start + dist(rng);
+		intervals.emplace_back(start, end);
+		t = end;
+	}
+
+	for (const auto &i : intervals)
+		writer.append(i.first, i.second);
+
+	bool ok = check("write", writer.close());
+
+	preempt_trace_reader reader;
+	if (!check("open", reader.open(path)))
+		return false;
+
+	const preempt_trace::header &hdr = reader.get_header();
+	ok &= check("header", hdr.cpu == 0 && hdr.hz == time_unit::cpu_hz());
+
+	size_t n = 0;
+	bool same = true;
+	bool first = false;
+	u64 start, end;
+	while (reader.next(start, end)) {
+		if (n < intervals.size())
+			same &= start == intervals[n].first && end == intervals[n].second;
+		if (!n)
+			first = same;
+		n++;
+	}
+
+	ok &= check("interval before the anchor (10 byte varint)",
+		hdr.anchor_tsc > early && first);
+	ok &= check("intervals read back", n == intervals.size() && same);
+
+	return ok;
+}
+
+static void
+bench(const string &path, u64 nr)
+{
+	mt19937_64 rng(2);
+	uniform_int_distribution<u64> gap(0, (u64)1 << 20);
+	uniform_int_distribution<u64> len(0, (u64)1 << 14);
+
+	// generated up front, so only the encoding and write() are timed
+	vector<u64> tsc(2 * nr);
+	u64 t = read_tsc();
+	for (u64 i=0; i<nr; ++i) {
+		tsc[2 * i] = t + gap(rng);
+		tsc[2 * i + 1] = tsc[2 * i] + len(rng);
+		t = tsc[2 * i + 1];
+	}
+
+	preempt_trace_writer writer;
+	if (!writer.open(path, 0))
+		return;
+
+	time_unit begin = time_unit::NOW(false);
+	for (u64 i=0; i<nr; ++i)
+		writer.append(tsc[2 * i], tsc[2 * i + 1]);
+	writer.close();
+	double write_secs = (double)time_unit::NOW(false).diff(begin).nanosecs() / 1E9;
+
+	preempt_trace_reader reader;
+	if (!reader.open(path))
+		return;
+	begin = time_unit::NOW(false);
+	u64 n = 0, start, end;
+	while (reader.next(start, end))
+		n++;
+	double read_secs = (double)time_unit::NOW(false).diff(begin).nanosecs() / 1E9;
+
+	FILE *f = fopen(path.c_str(), "r");
+	fseek(f, 0, SEEK_END);
+	double file_bytes = (double)ftell(f);
+	fclose(f);
+
+	printf("%llu intervals: written in %.2f secs (%.0f MB/s, %.2f bytes/interval), "
+		"read back in %.2f secs%s\n",
+		(unsigned long long)nr, write_secs, file_bytes / 1E6 / write_secs,
+		file_bytes / (double)nr, read_secs, n == nr ? "" : " (MISMATCH)");
+}
+
+int main(int argc, char *argv[])
+{
+	u64 nr = argc > 1 ? strtoull(argv[1], NULL, 0) : 10 * 1000 * 1000;
+	string path = argc > 2 ? argv[2] : "preempt_trace_test." + to_string(getpid()) + ".trace";
+
+	// the writer needs cpu_hz
+	time_unit init(true);
+
+	bool ok = round_trip(path);
+	if (nr)
+		bench(path, nr);
+
+	unlink(path.c_str());
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
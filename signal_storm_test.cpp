@@ -0,0 +1,172 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+#include <csignal>
+#include <pthread.h>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+using namespace std;
+
+#include "time_unit.h"
+#include "periodic_timer.h"
+
+/**
+ * DESCRIPTION:
+ * Sleeps (absolute, relative and precise) while another thread interrupts
+ * the sleeping thread with a signal every few usecs, and checks that every
+ * sleep still ends at (not before, and not long after) its deadline.
+ *
+ * Every interrupted sleep is re-issued with the same (absolute) deadline, so
+ * the error should not depend on the number of interruptions (resuming a
+ * relative sleep with the time remaining adds the handler's and the restart's
+ * time on every interruption).  So every kind of sleep is first run without
+ * signals, and fails under the storm if its mean error is more than
+ * max_mean_increase_ns, or its max error more than max_max_increase_ns, above
+ * that baseline (a few handler runs' worth, far below the error of resuming
+ * with the time remaining after thousands of interruptions).
+ *
+ * usage: signal_storm_test [signal interval usecs (default 20)]
+ * 	[sleep msecs (default 100)] [sleeps (default 10)]
+ */
+
+// allowed increase of the error over the run without signals
+static const s64 max_mean_increase_ns = 100 * 1000;
+static const s64 max_max_increase_ns = 500 * 1000;
+
+static atomic<u64> nr_handled(0);
+
+struct sleep_errors {
+	s64 mean;
+	s64 max;
+	bool ok;    // no early wakeup and no failure
+};
+
+static void
+SIG_storm(int)
+{
+	nr_handled.fetch_add(1, memory_order_relaxed);
+}
+
+static sleep_errors
+run(const char *name, int mode, u64 sleep_ns, unsigned nr_sleeps)
+{
+	s64 max_error = 0;
+	s64 total_error = 0;
+	u64 interrupts = 0;
+	bool ok = true;
+
+	for (unsigned i=0; i<nr_sleeps; ++i) {
+		time_unit start = time_unit::NOW(false);
+		time_unit deadline = start;
+		deadline.add_ns(sleep_ns);
+
+		int rtn;
+		if (mode == 0) {
+			rtn = deadline.sleep_absolute(false);
+		} else if (mode == 1) {
+			time_unit length = time_unit::NANOSECS(sleep_ns, false);
+			rtn = length.sleep_relative(false);
+		} else {
+			rtn = deadline.sleep_precise(false);
+		}
+
+		s64 error = time_unit::NOW(false).diff(deadline).nanosecs();
+
+		if (rtn < 0 || error < 0)
+			ok = false;
+		else
+			interrupts += (u64)rtn;
+
+		total_error += error;
+		if (error > max_error)
+			max_error = error;
+	}
+
+	printf("%-9s interrupts/sleep %8.1f  error (usecs) mean %8.1f max %8.1f  %s\n",
+		name, (double)interrupts / nr_sleeps,
+		(double)total_error / 1E3 / nr_sleeps, (double)max_error / 1E3,
+		ok ? "ok" : "FAILED (early or error)");
+
+	return sleep_errors{ total_error / nr_sleeps, max_error, ok };
+}
+
+static bool
+compare(const char *name, const sleep_errors &base, const sleep_errors &storm)
+{
+	bool ok = storm.ok && base.ok;
+
+	if (storm.mean > base.mean + max_mean_increase_ns ||
+			storm.max > base.max + max_max_increase_ns) {
+		printf("%-9s error (usecs) mean %.1f max %.1f without signals, "
+			"%.1f %.1f with: FAILED (more than +%lld/+%lld)\n",
+			name, (double)base.mean / 1E3, (double)base.max / 1E3,
+			(double)storm.mean / 1E3, (double)storm.max / 1E3,
+			(long long)max_mean_increase_ns / 1000, (long long)max_max_increase_ns / 1000);
+		ok = false;
+	}
+
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	u64 interval_ns = (argc > 1 ? strtoull(argv[1], NULL, 0) : 20) * 1000;
+	u64 sleep_ns = (argc > 2 ? strtoull(argv[2], NULL, 0) : 100) * 1000 * 1000;
+	unsigned nr_sleeps = argc > 3 ? (unsigned)atoi(argv[3]) : 10;
+
+	if (!interval_ns || !sleep_ns || !nr_sleeps) {
+		cout << "usage: " << argv[0] << " [signal interval usecs] [sleep msecs] [sleeps]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	// no SA_RESTART: nanosleep() is never restarted by the kernel anyway
+	struct sigaction sa;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sa.sa_handler = SIG_storm;
+	sigaction(SIGUSR2, &sa, 0);
+
+	// calibrate before measuring (sleep_precise())
+	time_unit init(true);
+
+	const char *names[] = { "absolute", "relative", "precise" };
+	sleep_errors base[3];
+
+	cout << "no signals, sleeps of " << sleep_ns / 1000000 << " msecs" << endl;
+	for (int mode=0; mode<3; ++mode)
+		base[mode] = run(names[mode], mode, sleep_ns, nr_sleeps);
+
+	pthread_t sleeper = pthread_self();
+	atomic<bool> stop(false);
+	u64 nr_sent = 0;
+
+	// skips the signals it is late for, rather than sending them back to back
+	thread storm([&]() {
+		periodic_timer timer(time_unit::NANOSECS(interval_ns), periodic_timer::OVERRUN_SKIP);
+		timer.start();
+		while (!stop.load(memory_order_relaxed)) {
+			pthread_kill(sleeper, SIGUSR2);
+			nr_sent++;
+			timer.wait();
+		}
+	});
+
+	cout << "signal every " << interval_ns / 1000 << " usecs, sleeps of "
+		<< sleep_ns / 1000000 << " msecs" << endl;
+
+	sleep_errors storm_errors[3];
+	for (int mode=0; mode<3; ++mode)
+		storm_errors[mode] = run(names[mode], mode, sleep_ns, nr_sleeps);
+
+	stop = true;
+	storm.join();
+
+	bool ok = true;
+	for (int mode=0; mode<3; ++mode)
+		ok &= compare(names[mode], base[mode], storm_errors[mode]);
+
+	cout << "signals sent " << nr_sent << ", handled " << nr_handled.load() << endl;
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "bench_helpers.h"
+
+/**
+ * DESCRIPTION:
+ * Extends nanosleep_test: sleeps until a series of absolute deadlines with
+ * sleep_absolute() and sleep_precise(), and reports how far from the deadline
+ * the thread woke up (percentiles, nsecs, negative is early) and the cpu time
+ * it used.
+ *
+ * usage: sleep_bench [period usecs (default 1000)] [sleeps (default 2000)]
+ */
+
+static const double percentiles[] = { 50, 90, 99, 99.9, 100 };
+
+static void
+bench(const char *name, bool precise, u64 period_ns, size_t nr_sleeps)
+{
+	vector<s64> errors;
+	errors.reserve(nr_sleeps);
+
+	time_unit deadline = time_unit::NOW(false);
+	u64 cpu_begin = thread_cpu_ns();
+	time_unit begin = deadline;
+
+	for (size_t i=0; i<nr_sleeps; ++i) {
+		deadline.add_ns(period_ns);
+
+		if (precise)
+			deadline.sleep_precise();
+		else
+			deadline.sleep_absolute();
+
+		errors.push_back(time_unit::NOW(false).diff(deadline).nanosecs());
+	}
+
+	u64 cpu_ns = thread_cpu_ns() - cpu_begin;
+	u64 wall_ns = time_unit::NOW(false).diff(begin).nanosecs();
+
+	sort(errors.begin(), errors.end());
+
+	printf("%-9s min %7lld", name, (long long)errors.front());
+	for (double p : percentiles) {
+		size_t idx = (size_t)(p / 100.0 * (double)(errors.size() - 1) + 0.5);
+		printf("  p%-4g %7lld", p, (long long)errors[idx]);
+	}
+	print_cpu_usage(cpu_ns, wall_ns, nr_sleeps, "sleep");
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	u64 period_ns = (argc > 1 ? strtoull(argv[1], NULL, 0) : 1000) * 1000;
+	size_t nr_sleeps = argc > 2 ? (size_t)strtoull(argv[2], NULL, 0) : 2000;
+
+	if (!period_ns || !nr_sleeps) {
+		cout << "usage: " << argv[0] << " [period usecs] [sleeps]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	// calibrate before measuring
+	time_unit init(true);
+
+	cout << "wakeup error (nsecs), period " << period_ns / 1000 << " usecs, "
+		<< nr_sleeps << " sleeps" << endl;
+
+	bench("absolute", false, period_ns, nr_sleeps);
+	bench("precise", true, period_ns, nr_sleeps);
+
+	const sleep_slack &slack = time_unit::precise_sleep_slack();
+	cout << "learned slack: " << slack.slack() << " nsecs (p" << slack.get_percentile()
+		<< " of the last " << min((u64)sleep_slack::nr_samples, slack.count())
+		<< " wakeups)" << endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Online estimate of how late a thread wakes up from clock_nanosleep() (see
+ * time_unit::sleep_precise()).
+ *
+ * Keeps the last nr_samples wakeup latencies (time from the requested wakeup
+ * to when the thread ran again) and returns a percentile of them as the
+ * slack: sleep_precise() sleeps until slack before the deadline and spins on
+ * the TSC for the rest.  A higher percentile spins longer but misses the
+ * deadline less often.  Following only recent wakeups, the slack adapts to
+ * changes of the timer slack, the idle states in use and the load of the
+ * host.
+ *
+ * Until min_samples latencies are known, initial_ns is used.
+ *
+ * Latencies above max_latency_ns are taken as preemptions of the thread
+ * rather than timer latency (spinning would not have helped) and clamped, so
+ * that a few of them cannot grow the slack beyond usefulness.  If the slack
+ * is longer than the sleeps requested, the thread only spins and no longer
+ * measures wakeups, so the slack is halved after nr_samples such sleeps in a
+ * row (spin_only()).
+ */
+
+#include <string.h>
+
+#include "data_types.h"
+
+class sleep_slack {
+	public:
+		static constexpr size_t nr_samples = 64;
+		static constexpr size_t min_samples = 8;
+		static constexpr u64 initial_ns = 100000;
+		static constexpr u64 max_latency_ns = 1000000;
+		static constexpr double default_percentile = 99;
+
+		explicit sleep_slack(double percentile=default_percentile)
+			: _percentile(percentile) { reset(); }
+
+		void reset(void);
+		void record(u64 latency_ns);
+		void spin_only(void);  // a sleep shorter than the slack
+
+		// current estimate, nsecs
+		u64 slack(void) const { return _slack; }
+		u64 count(void) const { return _count; }  // latencies recorded
+
+		double get_percentile(void) const { return _percentile; }
+		void set_percentile(double percentile) { _percentile = percentile; update(); }
+
+	private:
+		void update(void);
+
+		double _percentile;
+		u64 _count;
+		u64 _slack;
+		u64 _nr_spin_only;      // in a row
+		u64 _samples[nr_samples];
+};
+
+/**
+ * inline functions (must be put in header)
+ * https://isocpp.org/wiki/faq/inline-functions
+ */
+
+inline
+void sleep_slack::reset()
+{
+	_count = 0;
+	_slack = initial_ns;
+	_nr_spin_only = 0;
+	memset(_samples, 0, sizeof(_samples));
+}
+
+inline
+void sleep_slack::record(u64 latency_ns)
+{
+	_samples[_count % nr_samples] = latency_ns < max_latency_ns ? latency_ns : max_latency_ns;
+	_count++;
+	_nr_spin_only = 0;
+
+	update();
+}
+
+inline
+void sleep_slack::spin_only()
+{
+	if (++_nr_spin_only < nr_samples)
+		return;
+
+	// recomputed from the samples once a sleep is long enough again
+	_nr_spin_only = 0;
+	_slack /= 2;
+}
+
+/*
+ * Sorts a copy of at most nr_samples values, about a usec once per sleep
+ * (i.e., while the thread has time to spare).  An insertion sort, since
+ * std::nth_element's signed index arithmetic trips -Wstrict-overflow.
+ */
+inline
+void sleep_slack::update()
+{
+	if (_count < min_samples)
+		return;
+
+	size_t n = _count < nr_samples ? (size_t)_count : nr_samples;
+	size_t k = (size_t)(_percentile / 100.0 * (double)(n - 1) + 0.5);
+
+	u64 sorted[nr_samples];
+	for (size_t i=0; i<n; ++i) {
+		u64 val = _samples[i];
+		size_t j = i;
+		for (; j > 0 && sorted[j - 1] > val; --j)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = val;
+	}
+
+	_slack = sorted[k];
+}
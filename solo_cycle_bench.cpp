@@ -0,0 +1,142 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+#include <cmath>
+
+#include <vector>
+using namespace std;
+
+#include "x86_tsc.h"
+#include "time_unit.h"
+#include "cpu_consumer.h"
+#include "cpu_affinity.h"
+
+/**
+ * DESCRIPTION:
+ * solo_cycle (the shortest uninterrupted iteration of cpu_consumer's
+ * measurement loop) and the spread of the iteration lengths, for the loop as
+ * it was before it was made branch free (legacy) and for the current loop
+ * with different unroll factors.
+ *
+ * Every kernel runs nr_runs times, the solo_cycle mean/stddev are over the
+ * runs, the percentiles over the iterations of all runs.  Run it on an idle
+ * (isolated) cpu.
+ *
+ * usage: solo_cycle_bench [run length (msecs)] [nr_runs]
+ */
+
+/**
+ * The initialization loop of cpu_consumer::trial_loop() before it was made
+ * branch free (kept for comparison).
+ */
+static u64 legacy_solo_cycle(u64 run_cycles, preempt_histogram &iterations)
+{
+	const u64 max_no_preempt = time_unit::NANOSECS(200, true)._cycles;
+	const u64 one_sec = time_unit::SECS(1, true)._cycles;
+	u64 total = 0, min = one_sec, max_preempt = 0, nr_preempts = 0;
+
+	u64 stop = read_tsc() + run_cycles;
+	u64 curr = read_tsc() - one_sec;
+
+	while (cpu_consumer::stop_program == false) {
+		u64 before = curr;
+		curr = read_tsc();
+		u64 diff = curr - before;
+
+		iterations.record(diff);
+
+		if (diff > max_no_preempt) {
+			nr_preempts++;
+			total += min;
+			if (diff > max_preempt)
+				max_preempt = diff;
+		} else {
+			total += diff;
+			if (diff < min)
+				min = diff;
+		}
+
+		if (curr > stop)
+			break;
+	}
+
+	// keep the bookkeeping from being optimized away
+	volatile u64 sink = total + max_preempt + nr_preempts;
+	(void)sink;
+
+	return min;
+}
+
+static void report(const char *name, const vector<u64> &solo, const preempt_histogram &iterations)
+{
+	double sum = 0, sum_sq = 0;
+	u64 min = ~0ULL;
+
+	for (auto s : solo) {
+		sum += (double)s;
+		sum_sq += (double)s * (double)s;
+		if (s < min)
+			min = s;
+	}
+
+	double n = (double)solo.size();
+	double mean = sum / n;
+	double stddev = sqrt(max(0.0, sum_sq / n - mean * mean));
+
+	printf("%-10s solo_cycle min: %4llu  mean: %7.2f  stddev: %6.2f | iteration p50: %4llu  p99: %5llu  p99.99: %6llu (cycles)\n",
+			name, (unsigned long long)min, mean, stddev,
+			(unsigned long long)iterations.percentile(50),
+			(unsigned long long)iterations.percentile(99),
+			(unsigned long long)iterations.percentile(99.99));
+}
+
+template <unsigned unroll>
+static void bench(const char *name, time_unit run_time, int nr_runs)
+{
+	vector<u64> solo;
+	preempt_histogram all, iterations;
+
+	for (int r=0; r<nr_runs; ++r) {
+		solo.push_back(cpu_consumer::calibrate_solo_cycle<unroll>(run_time, iterations)._cycles);
+		all.merge(iterations);
+	}
+
+	report(name, solo, all);
+}
+
+int main(int argc, char *argv[])
+{
+	u64 run_msecs = 200;
+	int nr_runs = 10;
+
+	if (argc > 1)
+		run_msecs = strtoull(argv[1], NULL, 10);
+	if (argc > 2)
+		nr_runs = atoi(argv[2]);
+
+	// calibrates cpu_hz
+	time_unit run_time = time_unit::MILLISECS(run_msecs, true);
+
+	vector<int> cpus = allowed_cpus();
+	if (cpus.empty() || !pin_to_cpu(cpus.back())) {
+		printf("unable to pin to a cpu\n");
+		return EXIT_FAILURE;
+	}
+	printf("cpu %d, %d runs of %llu msecs\n", cpus.back(), nr_runs, (unsigned long long)run_msecs);
+
+	{
+		vector<u64> solo;
+		preempt_histogram all;
+
+		for (int r=0; r<nr_runs; ++r)
+			solo.push_back(legacy_solo_cycle(run_time._cycles, all));
+
+		report("legacy", solo, all);
+	}
+
+	bench<1>("unroll 1", run_time, nr_runs);
+	bench<2>("unroll 2", run_time, nr_runs);
+	bench<4>("unroll 4", run_time, nr_runs);
+	bench<8>("unroll 8", run_time, nr_runs);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Fixed size, lock-free ring buffer for exactly one producer thread and one
+ * consumer thread.
+ *
+ * push() is meant for measurement loops: it is a store plus an index bump,
+ * and never blocks or fails.  If the ring is full the value is dropped and
+ * counted (see overflows()); the producer continues.
+ *
+ * To make that possible without a branch on the full case, the ring holds one
+ * element less than its size: the slot just before the oldest unread element
+ * is never read, so push() can always write to the next slot and only then
+ * decide whether to publish it.
+ *
+ * Each side caches the other side's index and only reloads it (i.e., only
+ * touches the other side's cache line) when the cached value says the ring
+ * is full (producer) or empty (consumer).
+ *
+ * The elements live in a mapped_buffer, faulted in by the constructor (see
+ * mapped_buffer.h for hugepages and locking), so T must be trivially
+ * copyable.
+ */
+
+#include <atomic>
+#include <type_traits>
+
+#include "data_types.h"
+#include "mapped_buffer.h"
+
+template <class T>
+class spsc_ring {
+	public:
+		// @size is rounded up to a power of 2, the ring holds size - 1 elements
+		explicit spsc_ring(size_t size, const mapped_buffer::options &mem=mapped_buffer::options());
+
+		spsc_ring(const spsc_ring &) = delete;
+		spsc_ring &operator=(const spsc_ring &) = delete;
+
+		size_t capacity(void) const { return _mask; }
+		const mapped_buffer &memory(void) const { return _mem; }
+
+		// producer only
+		void push(const T &val);
+
+		// values dropped because the ring was full (producer, or after
+		// synchronizing with it)
+		u64 overflows(void) const { return _nr_overflows; }
+
+		// consumer only, @return - number of values copied to @out
+		size_t pop(T *out, size_t max);
+
+	private:
+		/*
+		 * The three groups are kept on separate cache lines with padding
+		 * rather than alignas, since (before C++17) new does not honor
+		 * alignments beyond 16 bytes.
+		 */
+
+		// read-only after construction
+		mapped_buffer _mem;
+		T *_buf;
+		u64 _mask;
+		char _pad0[64];
+
+		// producer
+		std::atomic<u64> _head;  // next slot to write
+		u64 _cached_tail;
+		u64 _nr_overflows;
+		char _pad1[64];
+
+		// consumer
+		std::atomic<u64> _tail;  // next slot to read
+		u64 _cached_head;
+		char _pad2[64];
+};
+
+template <class T>
+spsc_ring<T>::spsc_ring(size_t size, const mapped_buffer::options &mem)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "spsc_ring elements are not constructed");
+
+	size_t pow2 = 2;
+	while (pow2 < size)
+		pow2 <<= 1;
+
+	// faults in every page now (i.e., on the producer's numa node if it is
+	// constructed by the producer), not in the measurement loop
+	_mem.map(pow2 * sizeof(T), mem);
+	_buf = (T *)_mem.get();
+	_mask = pow2 - 1;
+
+	_head.store(0, std::memory_order_relaxed);
+	_cached_tail = 0;
+	_nr_overflows = 0;
+	_tail.store(0, std::memory_order_relaxed);
+	_cached_head = 0;
+}
+
+template <class T>
+inline
+void spsc_ring<T>::push(const T &val)
+{
+	u64 head = _head.load(std::memory_order_relaxed);
+
+	// either a free slot, or the (already read) slot before the tail
+	_buf[head & _mask] = val;
+
+	if (__builtin_expect(head - _cached_tail >= _mask, 0))
+		_cached_tail = _tail.load(std::memory_order_acquire);
+
+	u64 full = (u64)(head - _cached_tail >= _mask);
+
+	_nr_overflows += full;
+	_head.store(head + 1 - full, std::memory_order_release);
+}
+
+template <class T>
+inline
+size_t spsc_ring<T>::pop(T *out, size_t max)
+{
+	u64 tail = _tail.load(std::memory_order_relaxed);
+
+	if (_cached_head == tail)
+		_cached_head = _head.load(std::memory_order_acquire);
+
+	size_t n = (size_t)(_cached_head - tail);
+	if (n > max)
+		n = max;
+
+	for (size_t i=0; i<n; ++i)
+		out[i] = _buf[(tail + i) & _mask];
+
+	_tail.store(tail + n, std::memory_order_release);
+
+	return n;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Signed length of time (nanoseconds), as opposed to a time instant
+ * (time_unit).
+ *
+ * 	instant - instant   -> duration  (time_unit::diff())
+ * 	instant +/- duration -> instant  (operator+/- in time_unit.h)
+ * 	duration +/- duration, duration * or / integer -> duration
+ *
+ * None of these exit or print on negative results, a negative duration is a
+ * normal value (see is_negative()).
+ *
+ * What happens on overflow (+/- 292 years) is chosen at compile time by the
+ * OverflowPolicy template parameter:
+ *
+ * 	saturate_overflow - the result is clamped to min()/max() (+/- S64_MAX,
+ * 	                    so negating never overflows)
+ * 	checked_overflow  - the result becomes invalid (see valid()), and stays
+ * 	                    invalid through any further arithmetic (like a NaN)
+ *
+ * Overflow is detected with the gcc overflow builtins, so +, - and * compile
+ * to the operation plus a conditional move.
+ */
+
+#include <limits>
+#include <ostream>
+
+#include "data_types.h"
+
+struct saturate_overflow {
+	static const char *name(void) { return "saturate"; }
+
+	static s64 on_overflow(bool negative)
+	{
+		return negative ? -S64_MAX : S64_MAX;
+	}
+
+	// saturated values are ordinary values
+	static bool is_invalid(s64) { return false; }
+	static s64 propagate(s64 val, s64, s64) { return val; }
+};
+
+struct checked_overflow {
+	static const char *name(void) { return "checked"; }
+
+	// s64 min is reserved as the invalid value
+	static s64 invalid(void) { return std::numeric_limits<s64>::min(); }
+
+	static s64 on_overflow(bool) { return invalid(); }
+
+	static bool is_invalid(s64 val) { return invalid() == val; }
+	static s64 propagate(s64 val, s64 a, s64 b)
+	{
+		return (invalid() == a) | (invalid() == b) ? invalid() : val;
+	}
+};
+
+template <class OverflowPolicy>
+class basic_duration {
+	public:
+		typedef OverflowPolicy policy;
+
+		constexpr basic_duration(void) : _nsecs(0) {}
+
+		// the same length with a different overflow policy
+		template <class P>
+		explicit basic_duration(basic_duration<P> d) : _nsecs(d.nanosecs()) {}
+
+		static basic_duration NANOSECS(s64 nsecs) { return basic_duration(nsecs); }
+		static basic_duration MICROSECS(s64 usecs) { return basic_duration(usecs) * 1000; }
+		static basic_duration MILLISECS(s64 msecs) { return basic_duration(msecs) * 1000000; }
+		static basic_duration SECS(s64 secs) { return basic_duration(secs) * 1000000000; }
+
+		/*
+		 * @nsecs is an unsigned count (e.g., time_unit::get_nanosecs()),
+		 * values > max() overflow
+		 */
+		static basic_duration from_nanosecs(u64 nsecs)
+		{
+			return basic_duration(nsecs > (u64)S64_MAX
+					? OverflowPolicy::on_overflow(false) : (s64)nsecs);
+		}
+
+		static basic_duration max(void) { return basic_duration(S64_MAX); }
+		static basic_duration min(void) { return basic_duration(-S64_MAX); }
+
+		constexpr s64 nanosecs(void) const { return _nsecs; }
+		s64 get_microsecs(void) const { return _nsecs / 1000; }
+		double get_millisecs(void) const { return (double)_nsecs / 1E6; }
+		double get_seconds(void) const { return (double)_nsecs / 1E9; }
+
+		constexpr bool is_zero(void) const { return 0 == _nsecs; }
+		constexpr bool is_negative(void) const { return _nsecs < 0; }
+		bool valid(void) const { return !OverflowPolicy::is_invalid(_nsecs); }
+
+		basic_duration abs(void) const { return is_negative() ? -*this : *this; }
+
+		basic_duration operator+(basic_duration rhs) const
+		{
+			s64 rtn;
+			if (__builtin_add_overflow(_nsecs, rhs._nsecs, &rtn))
+				rtn = OverflowPolicy::on_overflow(rhs._nsecs < 0);
+			return basic_duration(OverflowPolicy::propagate(rtn, _nsecs, rhs._nsecs));
+		}
+
+		basic_duration operator-(basic_duration rhs) const
+		{
+			s64 rtn;
+			if (__builtin_sub_overflow(_nsecs, rhs._nsecs, &rtn))
+				rtn = OverflowPolicy::on_overflow(rhs._nsecs > 0);
+			return basic_duration(OverflowPolicy::propagate(rtn, _nsecs, rhs._nsecs));
+		}
+
+		basic_duration operator-(void) const
+		{
+			return basic_duration(0) - *this;
+		}
+
+		basic_duration operator*(s64 multiplier) const
+		{
+			s64 rtn;
+			if (__builtin_mul_overflow(_nsecs, multiplier, &rtn))
+				rtn = OverflowPolicy::on_overflow((_nsecs < 0) != (multiplier < 0));
+			return basic_duration(OverflowPolicy::propagate(rtn, _nsecs, 0));
+		}
+
+		/*
+		 * Truncates towards 0.  Dividing by 0 overflows (towards the sign
+		 * of this duration).
+		 */
+		basic_duration operator/(s64 divisor) const
+		{
+			// also covers s64 min / -1
+			if (0 == divisor || (-1 == divisor && _nsecs == std::numeric_limits<s64>::min()))
+				return basic_duration(OverflowPolicy::propagate(
+							OverflowPolicy::on_overflow(_nsecs < 0), _nsecs, 0));
+			return basic_duration(OverflowPolicy::propagate(_nsecs / divisor, _nsecs, 0));
+		}
+
+		basic_duration &operator+=(basic_duration rhs) { return *this = *this + rhs; }
+		basic_duration &operator-=(basic_duration rhs) { return *this = *this - rhs; }
+		basic_duration &operator*=(s64 multiplier) { return *this = *this * multiplier; }
+		basic_duration &operator/=(s64 divisor) { return *this = *this / divisor; }
+
+		constexpr bool operator==(basic_duration rhs) const { return _nsecs == rhs._nsecs; }
+		constexpr bool operator!=(basic_duration rhs) const { return _nsecs != rhs._nsecs; }
+		constexpr bool operator<(basic_duration rhs) const { return _nsecs < rhs._nsecs; }
+		constexpr bool operator<=(basic_duration rhs) const { return _nsecs <= rhs._nsecs; }
+		constexpr bool operator>(basic_duration rhs) const { return _nsecs > rhs._nsecs; }
+		constexpr bool operator>=(basic_duration rhs) const { return _nsecs >= rhs._nsecs; }
+
+	private:
+		constexpr explicit basic_duration(s64 nsecs) : _nsecs(nsecs) {}
+
+		s64 _nsecs;
+};
+
+static_assert(sizeof(basic_duration<saturate_overflow>) == 8, "basic_duration must stay 8 bytes");
+
+typedef basic_duration<saturate_overflow> time_duration;
+typedef basic_duration<checked_overflow> checked_duration;
+
+template <class OverflowPolicy>
+inline
+basic_duration<OverflowPolicy> operator*(s64 multiplier, basic_duration<OverflowPolicy> d)
+{
+	return d * multiplier;
+}
+
+template <class OverflowPolicy>
+inline
+std::ostream& operator<<(std::ostream &out, basic_duration<OverflowPolicy> d)
+{
+	if (!d.valid())
+		return out << "duration(invalid)";
+
+	return out << "duration(" << d.nanosecs() << " nsecs)";
+}
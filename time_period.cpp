@@ -32,16 +32,20 @@ time_period::use_cycles(bool choice)
 }
 */
 
+/*
+ * The TSC reads are fenced so that the code being measured can neither move
+ * before start() nor after stop().
+ */
 void
 time_period::start()
 {
-	_start_time.set_now();
+	_start_time.set_now<tsc_read::begin>();
 }
 
 void
 time_period::stop()
 {
-	_stop_time.set_now();
+	_stop_time.set_now<tsc_read::end>();
 }
 
 u64
@@ -94,3 +98,9 @@ time_period::get_diff_tu()
 {
 	return _stop_time - _stop_time;
 }
+
+time_duration
+time_period::get_duration() const
+{
+	return _stop_time.diff(_start_time);
+}
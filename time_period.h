@@ -19,6 +19,7 @@ class time_period {
 		u64 get_diff_cycles();
 
 		time_unit get_diff_tu();
+		time_duration get_duration() const;  // stop - start, may be negative
 
 		time_unit _start_time, _stop_time;
 	private :
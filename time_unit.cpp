@@ -7,6 +7,7 @@
 #include <netdb.h>
 #include <math.h>
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/syscall.h>   /* For SYS_xxx definitions */
@@ -18,6 +19,8 @@
 #include <limits>
 #include <random>
 #include <chrono>
+#include <mutex>
+#include <atomic>
 using namespace std;
 
 #include <boost/numeric/conversion/cast.hpp>
@@ -29,6 +32,9 @@ using boost::numeric_cast;
 #include "gcc_helpers/debug.h"
 
 #include "time_unit.h"
+#include "timespec_arith.h"
+#include "tsc_calibration.h"
+#include "calibration_cache.h"
 
 /*
  * x86 assembly(i.e., rdtsc) will fail on arm compile
@@ -42,14 +48,17 @@ using boost::numeric_cast;
 //#pragma message "INFO: Compiling for X86"
 #endif
 
-//double time_unit::_cpu_hz = 3010643978.40235294117647058823;
-double time_unit::_cpu_hz = 0;
+// guards the lazy initialization of cpu_hz by the first cycles time_unit
+static once_flag cpu_hz_once;
+
+const clock_page::data *time_unit::_clock_page = nullptr;
+
+// see nr_skew_clamps()
+static atomic<u64> nr_clamps(0);
 
 // default instantiation of time_unit objects
 bool time_unit::default_use_cycles = compile_default_use_cycles;
 
-constexpr auto NSEC_PER_SEC((s64)1E9);
-
 const time_unit time_unit::ONE_MICRO = time_unit((u64)1E3);
 
 time_unit
@@ -92,6 +101,25 @@ time_unit::NOW(bool cycles_store)
 	return rtn;
 }
 
+/**
+ * Current CLOCK_REALTIME (wall-clock) time, rather than _clock_id.
+ */
+time_unit
+time_unit::REALTIME()
+{
+	time_unit rtn(false);
+	u64 ns;
+
+	// falls back to the system call once the page's publisher is gone
+	if (_clock_page && clock_page::current_real_ns(_clock_page, read_tsc(), ns)) {
+		rtn.set_nanosecs(ns);
+	} else {
+		CHECK(clock_gettime(CLOCK_REALTIME, &rtn._timespec));
+	}
+
+	return rtn;
+}
+
 /**
  * timestamp format is expected to be <sec>.<fraction of second> (e.g., 23.829)
  */
@@ -126,7 +154,7 @@ time_unit::time_unit()
 {}
 
 time_unit::time_unit(bool cycles_time_storage)
-	: _use_cycles(cycles_time_storage)
+	: _use_cycles(cycles_time_storage), _tsc_cpu(tsc_skew::no_cpu)
 {
 	// use _cycles -or- _timespec as base timekeeping
 	// in general, try to use _timespec due to much larger time interval coverage
@@ -147,11 +175,50 @@ time_unit::time_unit(bool cycles_time_storage)
 
 	_cycles = 0;
 
-	// _cpu_hz only needed if cycles are used for timekeeping
+	// cpu_hz only needed if cycles are used for timekeeping
 	if (_use_cycles)
 		init_cycles_timekeeping();
 }
 
+// negative lengths of time are not supported by time_unit
+template <class ClockTag>
+static void
+check_not_negative(basic_time_unit<ClockTag> t)
+{
+	if (t.ticks() < 0) {
+		cout << "Can't convert " << t << " (negative) to a time_unit, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+time_unit::time_unit(const tsc_time_unit &t)
+	: time_unit(true)
+{
+	check_not_negative(t);
+	_cycles = (u64)t.ticks();
+}
+
+time_unit::time_unit(const ns_time_unit &t)
+	: time_unit(false)
+{
+	check_not_negative(t);
+	set_nanosecs((u64)t.ticks());
+}
+
+template <>
+tsc_time_unit
+tsc_time_unit::NOW()
+{
+	return tsc_time_unit((s64)read_tsc());
+}
+
+template <>
+ns_time_unit
+ns_time_unit::NOW()
+{
+	return time_unit::NOW(false).to_basic<ns_clock>();
+}
+
 time_unit::time_unit(u64 nanosecs)
 	: time_unit()
 {
@@ -161,14 +228,24 @@ time_unit::time_unit(u64 nanosecs)
 void
 time_unit::init_cycles_timekeeping()
 {
-	// TODO: may be a race condition if multiple threads instatiate objects at the same time.
-	// Use double check locking? (easy in C++11 due to memory model)
-	// i.e., cpu_hz class that implements lazy initialization
-	if (0 == _cpu_hz) {
-		if (!init_hz_from_file()) {
-			init_hz(4);
+	// fast path, once initialized this is only a load
+	if (clock_params::is_set())
+		return;
+
+	// multiple threads may instantiate the first cycles time_units at the
+	// same time, only one of them calibrates
+	call_once(cpu_hz_once, [this]() {
+		if (clock_params::is_set())
+			return;
+		// a clock page published on this host needs no calibration at all
+		if (getenv("TIME_UNIT_CLOCK_PAGE") && attach_clock_page())
+			return;
+
+		// an explicit .cpu_hz takes precedence over the calibration cache
+		if (!init_hz_from_file() && !init_hz_from_cache()) {
+			init_hz_fast();
 		}
-	}
+	});
 }
 
 bool
@@ -176,7 +253,13 @@ time_unit::init_hz_from_file()
 {
 	// TODO: just use home dir for now
 	// should allow it to be specified by caller?
-	string home_dir = getenv ("HOME");
+	// (calibration_cache allows its path to be specified)
+	const char *home_env = getenv("HOME");
+	if (!home_env) {
+		cout << "HOME not set, not using .cpu_hz" << endl;
+		return false;
+	}
+	string home_dir = home_env;
 	string file_name = home_dir + "/.cpu_hz";
 
 	if (!file_exists(file_name)) {
@@ -190,8 +273,8 @@ time_unit::init_hz_from_file()
 	u64 my_int;
 	if (!from_string<>(my_int, rtn_string)) {
 		// TODO: check proper conversion without loss of precision
-		_cpu_hz = numeric_cast<decltype(_cpu_hz)>(my_int);
-		printf("_cpu_hz (from file): %10.2f\n", _cpu_hz);
+		set_cpu_hz(numeric_cast<double>(my_int));
+		printf("cpu_hz (from file): %10.2f\n", cpu_hz());
 		return true;
 	} else {
 		cout << ".cpu_hz file exists, but unable to parse, exiting.";
@@ -209,7 +292,7 @@ time_unit::init_hz(int seconds)
 	u64 cyc_start, cyc_stop;
 	struct timespec ts_start, ts_stop;
 
-	printf("initializing _cpu_hz for %d seconds\n", seconds);
+	printf("initializing cpu_hz for %d seconds\n", seconds);
 	cyc_start = read_tsc();
 	ts_start = time_unit::read_ntptime();
 
@@ -222,11 +305,100 @@ time_unit::init_hz(int seconds)
 	// only really need secs for accuracy
 	u64 elapsed_sec = ts_stop.tv_sec - ts_start.tv_sec;
 
-	_cpu_hz = (double)elapsed_cycles/(double)elapsed_sec;
+	set_cpu_hz((double)elapsed_cycles/(double)elapsed_sec);
+
+	printf("cpu_hz: %10.2f\n", cpu_hz());
+
+	return numeric_cast<u64>(cpu_hz());
+}
+
+/**
+ * Initialize cpu_hz from a calibration made earlier on this host during the
+ * current boot (see calibration_cache.h).
+ */
+bool
+time_unit::init_hz_from_cache()
+{
+	tsc_calibration cal;
+
+	if (!calibration_cache::load(cal))
+		return false;
+
+	set_cpu_hz(cal.hz);
 
-	printf("_cpu_hz: %10.2f\n", _cpu_hz);
+	printf("cpu_hz (cached, %s): %10.2f (+/- %.2f ppm)\n", cal.source_str(), cpu_hz(), cal.error_ppm);
 
-	return numeric_cast<u64>(_cpu_hz);
+	return true;
+}
+
+/**
+ * Use the clock page published at @path (see clock_page.h, clock_daemon.cpp):
+ * cpu_hz is taken from it, and set_now() of timespec time_units converts the
+ * TSC with it instead of calling clock_gettime().  Once the page's publisher
+ * missed a few updates (e.g., clock_daemon exited), every read falls back to
+ * clock_gettime().
+ *
+ * NOTE: should be called before time_units are used by multiple threads.
+ */
+bool
+time_unit::attach_clock_page(const string &path)
+{
+	const clock_page::data *page = clock_page::attach(path);
+
+	if (!page)
+		return false;
+
+	clock_page::snapshot snap;
+	clock_page::read(page, snap);
+
+	set_cpu_hz(snap.hz);
+	_clock_page = page;
+
+	printf("cpu_hz (clock page %s): %10.2f\n", path.c_str(), cpu_hz());
+
+	return true;
+}
+
+bool
+time_unit::using_clock_page()
+{
+	return nullptr != _clock_page;
+}
+
+/**
+ * Initialize cpu_hz within milliseconds (see tsc_calibration.h), rather than
+ * the seconds (and ntp server) needed by init_hz().  The result is stored in
+ * the calibration cache for the following processes.
+ */
+u64
+time_unit::init_hz_fast()
+{
+	tsc_calibration cal = tsc_calibration::calibrate();
+
+	if (!cal.valid()) {
+		cout << "unable to calibrate cpu_hz, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	set_cpu_hz(cal.hz);
+
+	printf("cpu_hz (%s): %10.2f (+/- %.2f ppm)\n", cal.source_str(), cpu_hz(), cal.error_ppm);
+
+	calibration_cache::store(cal);
+
+	return numeric_cast<u64>(cpu_hz());
+}
+
+/**
+ * Set cpu_hz and precompute the fixed-point cycles <-> nsecs conversions.
+ *
+ * Safe to call at any time (e.g., to recalibrate) while other threads are
+ * using cycles time_units.
+ */
+void
+time_unit::set_cpu_hz(double hz)
+{
+	clock_params::set_hz(hz);
 }
 
 /**
@@ -357,6 +529,7 @@ time_unit::get_nanosecs() const
 		// large time values)
 		return cycles2nsec(this->_cycles);
 	} else {
+		// NOTE: negative times wrap (two's complement), see is_negative()
 		return ((u64)_timespec.tv_sec * NSEC_PER_SEC) + (u64)_timespec.tv_nsec;
 	}
 }
@@ -383,86 +556,13 @@ time_unit::get_seconds()
 	return (double)this->get_nanosecs() / (double)1E9;
 }
 
-static bool
-is_normalized(const struct timespec *ts)
-{
-	if (ts->tv_nsec >= (s64)1E9) return false;
-
-	if (ts->tv_nsec < 0) return false;
-
-	if (ts->tv_sec < 0) return false;
-
-	return true;
-}
-
-/**
- * Put sec and nsec into a timespec.
- *
- * Overwrites existing values in ts.
- */
-static void
-set_normalized_timespec(struct timespec *ts, s64 sec, s64 nsec)
-{
-// NOTE: divides work faster for larger numbers, smaller numbers will
-// work faster with while loop
-# if 1
-	if (nsec < 0) {
-		// make nsec positive
-		s64 borrow_sec = nsec / (s64)-1E9;
-		// we are less than 0, so we have to borrow at least 1 sec
-		borrow_sec += 1;
-
-		// TODO: check for neg. overflow
-		sec -= borrow_sec;
-		nsec += (borrow_sec * (s64)1E9);
-	}
-
-	// at this point, nsec must be positive, but sec could be negative
-
-	if (sec < 0) {
-		// TODO: not sure what to do about negative time?
-		// ts->tv_sec is signed, so it should be fine to return a negative seconds value
-		// however much of the code relying on time_unit does not expect neg. time
-		// maybe set a flag that will remove warning and exit below?
-		cerr << "sec < 0, not sure if this is expected?" << endl;
-		exit(EXIT_FAILURE);
-		sec = 0;
-	}
-
-	// ensure nsec input arg is < 1E9 by putting any above 1E9 into secs
-	u64 new_sec = nsec / (u64)1E9;
-	u64 new_nsec = nsec - (new_sec * NSEC_PER_SEC);
-
-	// TODO: check for overflow
-	ts->tv_sec = new_sec + sec;
-	ts->tv_nsec = new_nsec;
-#else
-
-/**
- * From linux kernel (include/linux/time.h)
- */
-	while (nsec >= NSEC_PER_SEC) {
-		nsec -= NSEC_PER_SEC;
-		++sec;
-	}
-	while (nsec < 0) {
-		nsec += NSEC_PER_SEC;
-		--sec;
-	}
-	// TODO: check for overflow
-	ts->tv_sec = (long)sec;
-	ts->tv_nsec = (time_t)nsec;
-#endif
-}
-
 int
 time_unit::set_nanosecs(u64 nsecs)
 {
 	if (_use_cycles) {
 		_cycles = nsec2cycles(nsecs);
 	} else {
-		// TODO: check for overflow of nsecs (u64 -> s64)
-		set_normalized_timespec(&_timespec, 0, nsecs);
+		set_timespec_nsecs(&_timespec, nsecs);
 	}
 
 	return 0;
@@ -502,13 +602,25 @@ time_unit::set_time_unit(const time_unit &tu)
 void
 time_unit::set_now()
 {
+	u64 ns;
+
 	if (_use_cycles) {
-		_cycles = read_tsc();
+		// corrected once tsc_skew found skew (see tsc_skew.h)
+		_cycles = tsc_skew::read(_tsc_cpu);
+	} else if (_clock_page && clock_page::current_mono_ns(_clock_page, read_tsc(), ns)) {
+		// NOTE: only valid since the page follows CLOCK_MONOTONIC (_clock_id)
+		set_nanosecs(ns);
 	} else {
 		CHECK(clock_gettime(_clock_id, &_timespec));
 	}
 }
 
+u64
+time_unit::nr_skew_clamps()
+{
+	return nr_clamps.load(memory_order_relaxed);
+}
+
 /**
  * @rhs:
  *     time_unit to subtract
@@ -520,7 +632,7 @@ time_unit::set_now()
  * Take a time unit and subtract it from this one.
  *
  * NOTE:
- * see set_normalized_timespec() handles for handling of neg. rtn value
+ * For timespec time_units the result may be negative (see is_negative()).
  */
 time_unit
 time_unit::subtract(const time_unit &rhs) const
@@ -528,6 +640,9 @@ time_unit::subtract(const time_unit &rhs) const
 	// this is lhs
 	time_unit rtn_val = *this;  // sets configuration of rtn value (e.g., _use_cycles)
 
+	// a length of time, not a reading
+	rtn_val._tsc_cpu = tsc_skew::no_cpu;
+
 	if (_use_cycles) {
 		// TODO: ensure both time_units are using _use_cycles
 
@@ -535,43 +650,31 @@ time_unit::subtract(const time_unit &rhs) const
 
 		// check for wrap
 		if (rtn_val._cycles > this->_cycles) {
-			cout << "negative _cycles will result (incorrect value of _cpu_hz?), exiting." << endl;
-			OUTPUT_NUM(this->_cpu_hz);
+			// rhs may have been read on another cpu whose TSC is ahead by
+			// less than the uncertainty of the correction (see tsc_skew.h),
+			// treat that as no time having elapsed
+			if (this->_tsc_cpu != tsc_skew::no_cpu && rhs._tsc_cpu != tsc_skew::no_cpu
+					&& this->_tsc_cpu != rhs._tsc_cpu
+					&& rhs._cycles - this->_cycles <= tsc_skew::max_skew() + tsc_skew::max_error()) {
+				nr_clamps.fetch_add(1, memory_order_relaxed);
+				rtn_val._cycles = 0;
+				return rtn_val;
+			}
+
+			cout << "negative _cycles will result (incorrect value of cpu_hz?), exiting." << endl;
+			OUTPUT_NUM(cpu_hz());
 			OUTPUT_NUM(this->_cycles);
 			OUTPUT_NUM(rhs._cycles);
 			// maybe just return/set to 0 if close?
 			exit(EXIT_FAILURE);
 		}
 	} else {
-		set_normalized_timespec(
-				&rtn_val._timespec,
-				this->_timespec.tv_sec - rhs._timespec.tv_sec,
-				this->_timespec.tv_nsec - rhs._timespec.tv_nsec
-		);
+		timespec_sub(&rtn_val._timespec, this->_timespec, rhs._timespec);
 	}
 
 	return rtn_val;
 }
 
-/**
- * timespec_add_ns - Adds nanoseconds to a timespec
- * @a:      pointer to timespec to be incremented
- * @ns:     unsigned nanoseconds value to be added
- *
- * from Linux kernel include/linux/time.h
- */
-static inline void
-timespec_add_ns(struct timespec *a, u64 ns)
-{
-	u64 secs = ns / (u64)1E9;
-	u64 nsecs = ns - (secs * (u64)1E9);
-
-	secs += a->tv_sec;
-	nsecs += a->tv_nsec;
-
-	set_normalized_timespec(a, secs, nsecs);
-}
-
 static inline void
 timespec_add_sec(struct timespec *a, time_t sec)
 {
@@ -586,6 +689,10 @@ time_unit::add(const time_unit &rhs) const
 {
 	time_unit rtn_val = *this;
 
+	// a reading plus a length is a reading (of the same cpu)
+	if (rtn_val._tsc_cpu == tsc_skew::no_cpu)
+		rtn_val._tsc_cpu = rhs._tsc_cpu;
+
 	if (_use_cycles) {
 		rtn_val._cycles = this->_cycles + rhs._cycles;
 		// wrap if sum is less (by unsigned comparison) than either of the operands
@@ -593,6 +700,8 @@ time_unit::add(const time_unit &rhs) const
 			cout << "Can't handle _cycles wrap (negative), exiting." << endl;
 			exit(EXIT_FAILURE);
 		}
+	} else if (!rhs._use_cycles) {
+		timespec_add(&rtn_val._timespec, this->_timespec, rhs._timespec);
 	} else {
 		timespec_add_ns(&rtn_val._timespec, rhs.get_nanosecs());
 	}
@@ -600,12 +709,64 @@ time_unit::add(const time_unit &rhs) const
 	return rtn_val;
 }
 
+/**
+ * @return:
+ *     this - rhs, negative if rhs is later
+ *
+ * DESCRIPTION:
+ * Unlike subtract(), the result is a length of time (see time_duration.h),
+ * so there is no need to compare the time_units first to avoid negative
+ * results.  Results beyond +/- 292 years saturate.
+ */
+time_duration
+time_unit::diff(const time_unit &rhs) const
+{
+	if (_use_cycles && rhs._use_cycles) {
+		// two's complement difference, so the TSC wrapping is handled too
+		u64 cycles = this->_cycles - rhs._cycles;
+
+		if ((s64)cycles < 0)
+			return -time_duration::from_nanosecs(cycles2nsec(0 - cycles));
+
+		return time_duration::from_nanosecs(cycles2nsec(cycles));
+	} else if (!_use_cycles && !rhs._use_cycles) {
+		return time_duration::SECS(this->_timespec.tv_sec)
+			- time_duration::SECS(rhs._timespec.tv_sec)
+			+ time_duration::NANOSECS((s64)this->_timespec.tv_nsec - rhs._timespec.tv_nsec);
+	} else {
+		return time_duration::NANOSECS((s64)(this->get_nanosecs() - rhs.get_nanosecs()));
+	}
+}
+
+/**
+ * @return - new time_unit @d later (earlier if @d is negative) than this
+ */
+time_unit
+time_unit::add(time_duration d) const
+{
+	time_unit rtn_val = *this;
+	s64 nsecs = d.nanosecs();
+
+	if (_use_cycles) {
+		u64 cycles = nsec2cycles(nsecs < 0 ? 0 - (u64)nsecs : (u64)nsecs);
+		// wraps like the TSC does
+		rtn_val._cycles = nsecs < 0 ? this->_cycles - cycles : this->_cycles + cycles;
+	} else {
+		timespec_add_signed_ns(&rtn_val._timespec, nsecs);
+	}
+
+	return rtn_val;
+}
+
 int
 time_unit::set_timespec(const struct timespec &ts)
 {
-	this->set_nanosecs(ts.tv_nsec);
-	// eventually calls normalize_timespec
-	this->add_sec(ts.tv_sec);
+	if (_use_cycles) {
+		this->set_nanosecs(ts.tv_nsec);
+		this->add_sec(ts.tv_sec);
+	} else {
+		set_normalized_timespec(&_timespec, ts.tv_sec, ts.tv_nsec);
+	}
 
 	return 0;
 }
@@ -629,6 +790,19 @@ time_unit::get_timespec() const
 	return _timespec;
 }
 
+/**
+ * The instant as sleep_absolute() sleeps until it, in nsecs since the epoch
+ * of CLOCK_MONOTONIC (e.g., a deadline for timer_wheel or timerfd).  Unlike
+ * get_nanosecs(), never converted from cycles.
+ */
+u64
+time_unit::get_monotonic_nanosecs() const
+{
+	const struct timespec ts = get_timespec();
+
+	return (u64)ts.tv_sec * NSEC_PER_SEC + (u64)ts.tv_nsec;
+}
+
 int
 time_unit::set_timeval(const struct timeval &tv)
 {
@@ -648,8 +822,10 @@ time_unit::get_timeval()
 {
 	struct timespec ts;
 
-	u64 nsecs = this->get_nanosecs();
-	set_normalized_timespec(&ts, 0, nsecs);
+	if (_use_cycles)
+		set_timespec_nsecs(&ts, this->get_nanosecs());
+	else
+		ts = _timespec;
 
 	struct timeval rtn_val;
 	rtn_val.tv_sec = ts.tv_sec;
@@ -680,6 +856,13 @@ time_unit::sub_sec(u64 secs)
 	this->set_time_unit(this->subtract(SECS(secs)));
 }
 
+bool
+time_unit::is_negative() const
+{
+	// _cycles are unsigned
+	return !_use_cycles && _timespec.tv_sec < 0;
+}
+
 bool
 time_unit::is_zero_time()
 {
@@ -717,50 +900,138 @@ time_unit::nsec2ts(uint64_t nsecs)
 	return rtn.get_timespec();
 }
 
-void
+/**
+ * @return - see nanosleep()
+ */
+int
 time_unit::sleep_absolute(bool exit_on_failure) const
 {
 	// check if *sleep() is even necessary (time may have passed)
 	if (time_unit::NOW() >= *this) {
 		//cout << "skipping sleep" << endl;
-		return;
+		return 0;
 	}
 
-	this->nanosleep(this->get_timespec(), TIMER_ABSTIME, exit_on_failure);
+	return this->nanosleep(this->get_timespec(), TIMER_ABSTIME, exit_on_failure);
 }
 
-void
+// per thread, wakeup latencies depend on the cpu (idle states, load)
+static thread_local sleep_slack precise_slack;
+
+sleep_slack &
+time_unit::precise_sleep_slack()
+{
+	return precise_slack;
+}
+
+/**
+ * Like sleep_absolute(), but returns at the deadline rather than up to the
+ * wakeup latency (often 50 - 100 usecs) after it: sleeps until the learned
+ * slack (see sleep_slack.h) before the deadline, then spins on the TSC.
+ *
+ * Costs about the slack in cpu time per sleep.  Initializes cpu_hz on first
+ * use if needed.
+ *
+ * @return - see nanosleep()
+ */
+int
+time_unit::sleep_precise(bool exit_on_failure) const
+{
+	const u64 deadline = get_monotonic_nanosecs();
+
+	// the spin needs cpu_hz: calibrate (the first time) before now is read
+	if (!clock_params::is_set())
+		time_unit calibrate(true);
+
+	u64 now = NOW(false).get_nanosecs();
+	if (now >= deadline)
+		return 0;
+
+	int rtn = 0;
+	u64 slack = precise_slack.slack();
+	if (deadline - now > slack) {
+		u64 wakeup = deadline - slack;
+
+		rtn = nanosleep(nsec2ts(wakeup), TIMER_ABSTIME, exit_on_failure);
+		if (rtn < 0)
+			return rtn;
+
+		now = NOW(false).get_nanosecs();
+		precise_slack.record(now > wakeup ? now - wakeup : 0);
+		if (now >= deadline)
+			return rtn;
+	} else {
+		precise_slack.spin_only();
+	}
+
+	// one clock read to map the deadline to the TSC, the rest spins on it
+	const u64 end = read_tsc() + nsec2cycles(deadline - now);
+
+	while (read_tsc() < end)
+		cpu_relax();
+
+	return rtn;
+}
+
+/**
+ * @return - see nanosleep()
+ */
+int
 time_unit::sleep_relative(bool exit_on_failure) const
 {
-	this->nanosleep(this->get_timespec(), 0, exit_on_failure);
+	return this->nanosleep(this->get_timespec(), 0, exit_on_failure);
 }
 
-void
+/**
+ * Sleeps until @tspec (@flags TIMER_ABSTIME) or for @tspec, restarting the
+ * sleep whenever a signal handler interrupts it (EINTR) with the same
+ * deadline.  A relative sleep is turned into an absolute one first: resuming
+ * with the remaining time would add the handler's and the restart's time to
+ * the sleep on every interruption (see signal_storm_test).
+ *
+ * @return - number of interruptions, or -errno on failure (if not
+ * 	@exit_on_failure)
+ */
+int
 time_unit::nanosleep(timespec tspec, int flags, bool exit_on_failure)
 {
-	long rtn;
+	int nr_interrupts = 0;
+	int err;
 
 	// HACK: may not be a good idea to reuse TIMER_ABSTIME from time.h, for now
 	// since TIMER_ABSTIME = 1 it should be ok
-	if (flags == TIMER_ABSTIME)
-		// last argument can be used to get remaining time
-		rtn = ::clock_nanosleep(_clock_id, TIMER_ABSTIME, &tspec, NULL);
+	if (flags != TIMER_ABSTIME) {
+		struct timespec now;
+		CHECK(clock_gettime(_clock_id, &now));
+		timespec_add(&tspec, now, tspec);
+	}
+
+	for (;;) {
+		// returns the error, rather than setting errno
+		err = ::clock_nanosleep(_clock_id, TIMER_ABSTIME, &tspec, NULL);
 
 		// bypass glibc if needed
-		//rtn = syscall(SYS_clock_nanosleep, _clock_id, TIMER_ABSTIME, &tspec, NULL);
-	else
-		rtn = ::nanosleep(&tspec, NULL);
+		//err = syscall(SYS_clock_nanosleep, _clock_id, TIMER_ABSTIME, &tspec, NULL);
+
+		if (err != EINTR)
+			break;
+
+		nr_interrupts++;
+	}
 
-	if (rtn) {
-		cout << "[clock_]nanosleep() failed with value (" << rtn << ")." << endl;
+	if (err) {
+		cout << "[clock_]nanosleep() failed with value (" << err << ")." << endl;
 		if (exit_on_failure) {
 			cout << "Exiting." << endl;
 			exit(EXIT_FAILURE);
 		}
+		return -err;
 	}
+
+	return nr_interrupts;
 }
 
-void
+int
 time_unit::nanosleep(u64 nsecs)
 {
 	// NOTE: easier/better to just use timespec since it is created locally here and OS requires timespec
@@ -768,10 +1039,10 @@ time_unit::nanosleep(u64 nsecs)
 
 	t_sleep.set_nanosecs(nsecs);
 
-	time_unit::nanosleep(t_sleep.get_timespec());
+	return time_unit::nanosleep(t_sleep.get_timespec());
 }
 
-void
+int
 time_unit::ssleep(u64 secs)
 {
 	timespec tspec;
@@ -779,7 +1050,7 @@ time_unit::ssleep(u64 secs)
 	tspec.tv_sec = secs;
 	tspec.tv_nsec = 0;
 
-	::nanosleep(&tspec, NULL);
+	return time_unit::nanosleep(tspec);
 }
 
 u64
@@ -793,10 +1064,10 @@ time_unit::random_nr(uint64_t max)
 	return number;
 }
 
-void
+int
 time_unit::random_sleep(u64 nsecs)
 {
-	time_unit::nanosleep(random_nr(nsecs));
+	return time_unit::nanosleep(random_nr(nsecs));
 }
 
 bool operator> (const time_unit &t1, const time_unit &t2)
@@ -804,6 +1075,8 @@ bool operator> (const time_unit &t1, const time_unit &t2)
 	// TODO: check if t1 and t2 have differing _use_cycles?
 	if (t1._use_cycles && t2._use_cycles) {
 		return t1._cycles > t2._cycles;
+	} else if (!t1._use_cycles && !t2._use_cycles) {
+		return timespec_compare(t1._timespec, t2._timespec) > 0;
 	} else {
 		return t1.get_nanosecs() > t2.get_nanosecs();
 	}
@@ -814,6 +1087,8 @@ bool operator>=(const time_unit &t1, const time_unit &t2)
 	// TODO: check if t1 and t2 have differing _use_cycles?
 	if (t1._use_cycles && t2._use_cycles) {
 		return t1._cycles >= t2._cycles;
+	} else if (!t1._use_cycles && !t2._use_cycles) {
+		return timespec_compare(t1._timespec, t2._timespec) >= 0;
 	} else {
 		return t1.get_nanosecs() >= t2.get_nanosecs();
 	}
@@ -824,6 +1099,8 @@ bool operator==(const time_unit &t1, const time_unit &t2)
 	// TODO: check if t1 and t2 have differing _use_cycles?
 	if (t1._use_cycles && t2._use_cycles) {
 		return t1._cycles == t2._cycles;
+	} else if (!t1._use_cycles && !t2._use_cycles) {
+		return timespec_compare(t1._timespec, t2._timespec) == 0;
 	} else {
 		return t1.get_nanosecs() == t2.get_nanosecs();
 	}
@@ -834,6 +1111,8 @@ bool operator< (time_unit &t1, time_unit &t2)
 	// TODO: check if t1 and t2 have differing _use_cycles?
 	if (t1._use_cycles && t2._use_cycles) {
 		return t1._cycles < t2._cycles;
+	} else if (!t1._use_cycles && !t2._use_cycles) {
+		return timespec_compare(t1._timespec, t2._timespec) < 0;
 	} else {
 		return t1.get_nanosecs() < t2.get_nanosecs();
 	}
@@ -849,6 +1128,16 @@ time_unit operator+ (const time_unit &t1, const time_unit &t2)
 	return t1.add(t2);
 }
 
+time_unit operator+ (const time_unit &t, time_duration d)
+{
+	return t.add(d);
+}
+
+time_unit operator- (const time_unit &t, time_duration d)
+{
+	return t.add(-d);
+}
+
 time_unit operator* (const time_unit &lhs, const u64 multiplier)
 {
 	time_unit rtn(lhs);
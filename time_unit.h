@@ -20,10 +20,18 @@
 #include <ostream>
 
 #include "data_types.h"
+#include "clock_params.h"
+#include "clock_page.h"
+#include "basic_time_unit.h"
+#include "time_duration.h"
+#include "x86_tsc.h"
+#include "tsc_skew.h"
+#include "sleep_slack.h"
+
+class sleep_awaiter;
 
 class time_unit {
 	public:
-		static double _cpu_hz;
 		constexpr static bool compile_default_use_cycles = false;
 		static bool default_use_cycles;
 
@@ -34,18 +42,31 @@ class time_unit {
 		time_unit(void);
 		explicit time_unit(bool cycles_time_storage);
 
+		// compatibility with the compact representation (see basic_time_unit.h)
+		time_unit(const tsc_time_unit &t);
+		time_unit(const ns_time_unit &t);
+		template <class ClockTag>
+		basic_time_unit<ClockTag> to_basic(void) const;
+
 		const static time_unit ONE_MICRO;
 		static time_unit SECS(u64 secs, bool cycles_store=compile_default_use_cycles);
 		static time_unit MILLISECS(u64 msecs, bool cycles_store=compile_default_use_cycles);
 		static time_unit MICROSECS(u64 usecs, bool cycles_store=compile_default_use_cycles);
 		static time_unit NANOSECS(u64 nsecs, bool cycles_store=compile_default_use_cycles);
 		static time_unit NOW(bool cycles_store=compile_default_use_cycles);
+		static time_unit REALTIME(void);
 		static time_unit from_timestamp(const std::string &timestamp);
 
 		static std::string now_str(std::string format="%Y-%m-%d.%X");
 
 		u64 init_hz(int seconds);
+		static u64 init_hz_fast(void);
 		bool init_hz_from_file();
+		static bool init_hz_from_cache(void);
+		static bool attach_clock_page(const std::string &path=clock_page::default_path());
+		static bool using_clock_page(void);
+		static void set_cpu_hz(double hz);
+		static double cpu_hz(void);
 
 		bool using_cycles() const;
 		//int use_cycles(bool choice); // requires conversion between cycles and timespec
@@ -60,22 +81,32 @@ class time_unit {
 		int set_seconds(u64 secs);
 		int set_time_unit(const time_unit &tu);
 		void set_now(void);  // set the recorded time as the current time
+		template <tsc_read R>
+		void set_now(void);  // same, with the given TSC read variant (see x86_tsc.h)
 		time_unit subtract(const time_unit &rhs) const;
 		time_unit add(const time_unit &rhs) const;
+		time_duration diff(const time_unit &rhs) const;  // this - rhs, may be negative
+		time_unit add(time_duration d) const;
 		void add_ns(u64 nsecs);
 		void add_sec(u64 secs);
 		void sub_sec(u64 secs);
 
 		int set_timespec(const struct timespec &ts);
 		struct timespec get_timespec(void) const;
+		// of an instant of CLOCK_MONOTONIC, exits for cycles (like get_timespec())
+		u64 get_monotonic_nanosecs(void) const;
 
 		int set_timeval(const struct timeval &tv);
 		struct timeval get_timeval(void);
 
 		bool is_zero_time();
+		bool is_negative() const;
 
 		void set_max();
 
+		// subtract()s of readings of different cpus clamped to 0 (see tsc_skew.h)
+		static u64 nr_skew_clamps(void);
+
 		static u64 nsec2cycles(u64 nsecs);
 		static u64 cycles2nsec(u64 cycles);
 
@@ -83,15 +114,22 @@ class time_unit {
 
 		static struct timespec read_ntptime(void);
 
-		void sleep_absolute(bool exit_on_failure=true) const;
-		void sleep_relative(bool exit_on_failure=true) const;
+		// restarted when interrupted, @return - interruptions, or -errno
+		int sleep_absolute(bool exit_on_failure=true) const;
+		int sleep_precise(bool exit_on_failure=true) const;  // sleep, then spin
+		static sleep_slack &precise_sleep_slack(void);  // of the calling thread
+
+		// co_await in a coro_task (see coro_scheduler.h)
+		sleep_awaiter until(void) const;  // this (CLOCK_MONOTONIC) instant
+		sleep_awaiter after(void) const;  // this length from now
+		int sleep_relative(bool exit_on_failure=true) const;
 
-		static void nanosleep(timespec tspec, int flags = 0, bool exit_on_failure=true);
-		static void nanosleep(u64 nsecs);
-		static void ssleep(u64 secs);
+		static int nanosleep(timespec tspec, int flags = 0, bool exit_on_failure=true);
+		static int nanosleep(u64 nsecs);
+		static int ssleep(u64 secs);
 
 		static u64 random_nr(uint64_t max);
-		static void random_sleep(u64 nsecs);
+		static int random_sleep(u64 nsecs);
 
 		friend bool operator>(const time_unit &t1, const time_unit &t2);
 		friend bool operator>=(const time_unit &t1, const time_unit &t2);
@@ -101,15 +139,21 @@ class time_unit {
 		friend time_unit operator*(const time_unit &t, const u64 multiplier);
 		friend time_unit operator-(const time_unit &t1, const time_unit &t2);
 		friend time_unit operator+(const time_unit &t1, const time_unit &t2);
+		friend time_unit operator+(const time_unit &t, time_duration d);
+		friend time_unit operator-(const time_unit &t, time_duration d);
 
 		friend std::ostream& operator<< (std::ostream &out, const time_unit &t);
 
 	private:
 		// TODO: maybe make _use_cycles const?
 		bool _use_cycles; // use processor cycles to measure/store time
+		u32 _tsc_cpu;     // cpu the _cycles were read on, tsc_skew::no_cpu if not known
 		time_unit(u64);
 		void init_cycles_timekeeping(void);
 
+		// if attached, timespec time_units are read from it (see clock_page.h)
+		static const clock_page::data *_clock_page;
+
 		//CLOCK_MONOTONIC_RAW only supports reading functions, not sleeping functions
 		//(see kernel/posix-timers.c)
 		//clockid_t time_unit::_clock_id = CLOCK_MONOTONIC_RAW;
@@ -122,40 +166,67 @@ class time_unit {
  * https://isocpp.org/wiki/faq/inline-functions
  */
 
-// TODO: the *2cycles should be checked for accuracy and precision of operation
+/*
+ * Both conversions use the mult/shift pairs published by set_cpu_hz() (see
+ * clock_params.h), so they are only valid once cpu_hz() is initialized.
+ * Results that do not fit in a u64 are saturated.
+ */
 inline
 u64 time_unit::nsec2cycles(u64 nsecs)
 {
-	u64 rtn_val;
-#if 0
-	// _cycles can potentially be HUGE!, so check for overflow
-	if (0 != nsecs) {
-		if ( _cpu_hz > ULLONG_MAX / nsecs ) { // a * b would overflow
-			printf("Can't handle overflow, exiting");
-			exit(1);
+	return clock_params::nsec2cycles(nsecs);
+}
+
+inline
+u64 time_unit::cycles2nsec(u64 cycles)
+{
+	return clock_params::cycles2nsec(cycles);
+}
+
+/*
+ * Variants that return the cpu id also remove that cpu's TSC offset (see
+ * tsc_skew.h), so readings taken on different cpus can be compared.  The
+ * others read with rdtscp instead once tsc_skew is active, so that corrected
+ * and raw readings are never mixed.
+ */
+template <tsc_read R>
+inline
+void time_unit::set_now()
+{
+	if (_use_cycles) {
+		if (tsc_read_has_aux(R)) {
+			u32 aux = 0;
+			_cycles = tsc_skew::correct(read_tsc<R>(&aux), aux);
+			_tsc_cpu = tsc_aux_cpu(aux);
+		} else if (tsc_skew::active()) {
+			_cycles = tsc_skew::read(_tsc_cpu);
+		} else {
+			_cycles = read_tsc<R>();
+			_tsc_cpu = tsc_skew::no_cpu;
 		}
+	} else {
+		set_now();
 	}
-#endif
-	// TODO: only valid if _cpu_hz is initialized
-	// TODO: check for overflow
-	// TODO: would a different order of * and / be more precise?
-	// TODO: _cpu_hz * 1E9 could be constexpr
-	rtn_val = (u64)((double)nsecs / (double)1E9 * _cpu_hz);
-
-	return rtn_val;
 }
 
+template <>
 inline
-u64 time_unit::cycles2nsec(u64 cycles)
+tsc_time_unit time_unit::to_basic<tsc_clock>() const
+{
+	return tsc_time_unit((s64)(_use_cycles ? _cycles : nsec2cycles(get_nanosecs())));
+}
+
+template <>
+inline
+ns_time_unit time_unit::to_basic<ns_clock>() const
+{
+	return ns_time_unit((s64)get_nanosecs());
+}
+
+inline
+double time_unit::cpu_hz()
 {
-	// TODO: check for overflow
-	// TODO: would a different order of * and / be more precise?
-	// TODO: _cpu_hz * 1E9 could be constexpr
-
-	// (u64)((double)cycles / _cpu_hz * (double)1E9); // floating arithmetic
-	// integer (more accurate for smaller values upto what?) (TODO:really need to check for overflow!)
-	//return cycles * (u64)1E9 / (u64)_cpu_hz;
-	return (u64)((double)cycles * (1E9 / _cpu_hz));
+	return clock_params::hz();
 }
 
 #endif // TIME_UNIT_H
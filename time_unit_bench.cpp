@@ -0,0 +1,284 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "time_period.h"
+#include "timespec_arith.h"
+
+/**
+ * DESCRIPTION:
+ * Microbenchmarks for the time_unit arithmetic/conversion paths.
+ *
+ * usage: time_unit_bench [cpu_hz]
+ */
+
+// number of values converted per measurement
+constexpr size_t nr_vals = 1 << 20;
+constexpr int nr_rounds = 20;
+
+// conversions as done before the fixed-point engine (kept for comparison)
+static double double_hz;
+
+static inline u64 double_cycles2nsec(u64 cycles)
+{
+	return (u64)((double)cycles * (1E9 / double_hz));
+}
+
+static inline u64 double_nsec2cycles(u64 nsecs)
+{
+	return (u64)((double)nsecs / (double)1E9 * double_hz);
+}
+
+static inline u64 exact_convert(u64 val, u64 from_hz, u64 to_hz)
+{
+	u128 rtn = (u128)val * to_hz / from_hz;
+
+	return (rtn >> 64) ? ~0ULL : (u64)rtn;
+}
+
+static inline u64 abs_diff(u64 a, u64 b)
+{
+	return a > b ? a - b : b - a;
+}
+
+/**
+ * Returns the best (minimum) nsecs per conversion over nr_rounds.
+ */
+template <u64 (*conv)(u64)>
+static double bench(const vector<u64> &vals)
+{
+	time_period tp;
+	double best = 1E30;
+	volatile u64 sink;
+
+	for (int r=0; r<nr_rounds; ++r) {
+		u64 acc = 0;
+		tp.start();
+		for (auto v : vals)
+			acc += conv(v);
+		tp.stop();
+		sink = acc;
+
+		double per_op = (double)tp.get_diff_nsec() / (double)vals.size();
+		if (per_op < best)
+			best = per_op;
+	}
+	(void)sink;
+
+	return best;
+}
+
+static void report_accuracy(const char *name, const vector<u64> &vals,
+		u64 (*conv)(u64), u64 from_hz, u64 to_hz)
+{
+	u64 max_err = 0;
+	u64 worst_val = 0;
+
+	for (auto v : vals) {
+		u64 exact = exact_convert(v, from_hz, to_hz);
+		if (~0ULL == exact)
+			continue; // not representable, saturated by the engine
+		u64 err = abs_diff(conv(v), exact);
+		if (err > max_err) {
+			max_err = err;
+			worst_val = v;
+		}
+	}
+
+	printf("%-22s max_err: %20llu (at %llu)\n", name,
+			(unsigned long long)max_err, (unsigned long long)worst_val);
+}
+
+static void bench_conversions(u64 hz)
+{
+	mt19937_64 gen(1);
+	vector<u64> small_vals(nr_vals), full_vals(nr_vals);
+
+	// "typical" values (durations up to ~1 sec) and the full u64 range
+	uniform_int_distribution<u64> small_dist(0, hz);
+	for (auto &v : small_vals)
+		v = small_dist(gen);
+	for (auto &v : full_vals)
+		v = gen() >> (gen() & 63);
+	full_vals[0] = ~0ULL;
+	full_vals[1] = 0;
+
+	printf("--- cycles <-> nsecs (cpu_hz: %llu) ---\n", (unsigned long long)hz);
+
+	printf("%-22s %8.3f nsecs/op\n", "double cycles2nsec", bench<double_cycles2nsec>(small_vals));
+	printf("%-22s %8.3f nsecs/op\n", "fixed cycles2nsec", bench<time_unit::cycles2nsec>(small_vals));
+	printf("%-22s %8.3f nsecs/op\n", "double nsec2cycles", bench<double_nsec2cycles>(small_vals));
+	printf("%-22s %8.3f nsecs/op\n", "fixed nsec2cycles", bench<time_unit::nsec2cycles>(small_vals));
+
+	report_accuracy("double cycles2nsec", full_vals, double_cycles2nsec, hz, (u64)1E9);
+	report_accuracy("fixed cycles2nsec", full_vals, time_unit::cycles2nsec, hz, (u64)1E9);
+	report_accuracy("double nsec2cycles", full_vals, double_nsec2cycles, (u64)1E9, hz);
+	report_accuracy("fixed nsec2cycles", full_vals, time_unit::nsec2cycles, (u64)1E9, hz);
+}
+
+/*
+ * timespec arithmetic as done before timespec_arith.h (kept for comparison,
+ * minus the exit() on negative results)
+ */
+static void legacy_set_normalized_timespec(struct timespec *ts, s64 sec, s64 nsec)
+{
+	if (nsec < 0) {
+		s64 borrow_sec = nsec / (s64)-1E9;
+		borrow_sec += 1;
+		sec -= borrow_sec;
+		nsec += (borrow_sec * (s64)1E9);
+	}
+
+	u64 new_sec = (u64)nsec / (u64)1E9;
+	u64 new_nsec = (u64)nsec - (new_sec * (u64)1E9);
+
+	ts->tv_sec = (time_t)(new_sec + (u64)sec);
+	ts->tv_nsec = (long)new_nsec;
+}
+
+static void legacy_add(struct timespec *a, const struct timespec &b)
+{
+	// rhs.get_nanosecs(), then timespec_add_ns()
+	u64 ns = (u64)b.tv_sec * (u64)1E9 + (u64)b.tv_nsec;
+	u64 secs = ns / (u64)1E9;
+	u64 nsecs = ns - (secs * (u64)1E9);
+
+	secs += (u64)a->tv_sec;
+	nsecs += (u64)a->tv_nsec;
+
+	legacy_set_normalized_timespec(a, (s64)secs, (s64)nsecs);
+}
+
+static void legacy_sub(struct timespec *a, const struct timespec &b)
+{
+	legacy_set_normalized_timespec(a, (s64)a->tv_sec - b.tv_sec, (s64)a->tv_nsec - b.tv_nsec);
+}
+
+constexpr size_t nr_ops = (size_t)1E7;
+
+/**
+ * Latency (nsecs) of one operation: every operation depends on the result of
+ * the previous one.
+ */
+template <class OP>
+static double bench_latency(OP op)
+{
+	time_period tp;
+	double best = 1E30;
+
+	for (int r=0; r<5; ++r) {
+		tp.start();
+		op();
+		tp.stop();
+
+		double per_op = (double)tp.get_diff_nsec() / (double)nr_ops;
+		if (per_op < best)
+			best = per_op;
+	}
+
+	return best;
+}
+
+static void bench_arithmetic()
+{
+	// 0.7 sec steps, so that most operations carry/borrow a second
+	struct timespec step;
+	step.tv_sec = 0;
+	step.tv_nsec = 700000000;
+
+	struct timespec start;
+	start.tv_sec = 1000000;
+	start.tv_nsec = 123456789;
+
+	volatile long sink;
+
+	printf("--- timespec arithmetic (latency) ---\n");
+
+	printf("%-22s %8.3f nsecs/op\n", "legacy add", bench_latency([&]() {
+		struct timespec t = start;
+		for (size_t i=0; i<nr_ops; ++i)
+			legacy_add(&t, step);
+		sink = t.tv_nsec;
+	}));
+	printf("%-22s %8.3f nsecs/op\n", "timespec_add", bench_latency([&]() {
+		struct timespec t = start;
+		for (size_t i=0; i<nr_ops; ++i)
+			timespec_add(&t, t, step);
+		sink = t.tv_nsec;
+	}));
+	printf("%-22s %8.3f nsecs/op\n", "legacy sub", bench_latency([&]() {
+		struct timespec t = start;
+		for (size_t i=0; i<nr_ops; ++i)
+			legacy_sub(&t, step);
+		sink = t.tv_nsec;
+	}));
+	printf("%-22s %8.3f nsecs/op\n", "timespec_sub", bench_latency([&]() {
+		struct timespec t = start;
+		for (size_t i=0; i<nr_ops; ++i)
+			timespec_sub(&t, t, step);
+		sink = t.tv_nsec;
+	}));
+
+	time_unit tu_step(false), tu_start(false);
+	tu_step.set_timespec(step);
+	tu_start.set_timespec(start);
+
+	printf("%-22s %8.3f nsecs/op\n", "time_unit operator+", bench_latency([&]() {
+		time_unit t = tu_start;
+		for (size_t i=0; i<nr_ops; ++i)
+			t = t + tu_step;
+		sink = t._timespec.tv_nsec;
+	}));
+	printf("%-22s %8.3f nsecs/op\n", "time_unit operator-", bench_latency([&]() {
+		time_unit t = tu_start;
+		for (size_t i=0; i<nr_ops; ++i)
+			t = t - tu_step;
+		sink = t._timespec.tv_nsec;
+	}));
+
+	// signed difference of two instants, the old way (see ntp.cpp history)
+	// and with time_unit::diff()
+	time_unit tu_other(false);
+	tu_other.set_timespec(start);
+	tu_other.add_ns(500000000);
+
+	printf("%-22s %8.3f nsecs/op\n", "compare, then subtract", bench_latency([&]() {
+		time_unit t = tu_start;
+		for (size_t i=0; i<nr_ops; ++i) {
+			time_unit d = t > tu_other ? t - tu_other : tu_other - t;
+			t._timespec.tv_nsec = d._timespec.tv_nsec;
+		}
+		sink = t._timespec.tv_nsec;
+	}));
+	printf("%-22s %8.3f nsecs/op\n", "time_unit::diff", bench_latency([&]() {
+		time_unit t = tu_start;
+		for (size_t i=0; i<nr_ops; ++i) {
+			time_duration d = t.diff(tu_other);
+			t._timespec.tv_nsec = (long)(d.abs().nanosecs() % NSEC_PER_SEC);
+		}
+		sink = t._timespec.tv_nsec;
+	}));
+
+	(void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+	u64 hz = 3010643978ULL;
+
+	if (argc > 1)
+		hz = strtoull(argv[1], NULL, 10);
+
+	time_unit::set_cpu_hz((double)hz);
+	double_hz = time_unit::cpu_hz();
+
+	bench_conversions(hz);
+	bench_arithmetic();
+
+	return EXIT_SUCCESS;
+}
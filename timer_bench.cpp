@@ -0,0 +1,154 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "timer_wheel.h"
+#include "preempt_histogram.h"
+#include "bench_helpers.h"
+
+/**
+ * DESCRIPTION:
+ * Dispatch latency (callback/wakeup - deadline) and cpu usage of many
+ * concurrent deadlines, spread uniformly over a window:
+ *
+ * 	- a timer_wheel on one thread, with all timers
+ * 	- a timer_wheel on one thread, with as many timers as threads below
+ * 	- one thread per deadline, sleeping with sleep_absolute()
+ *
+ * usage: timer_bench [timers (default 100000)] [window msecs (default 1000)]
+ * 	[tick usecs (default 10)] [threads (default 1000)]
+ */
+
+// time to set up (add the timers / start the threads) before the window
+static const u64 setup_ns = 500 * 1000 * 1000;
+
+static vector<u64>
+deadlines(size_t n, u64 window_ns)
+{
+	mt19937_64 rng(n);
+	uniform_int_distribution<u64> dist(0, window_ns);
+
+	u64 epoch = time_unit::NOW(false).get_nanosecs() + setup_ns;
+
+	vector<u64> d(n);
+	for (auto &ns : d)
+		ns = epoch + dist(rng);
+
+	return d;
+}
+
+static void
+report(const char *name, size_t n, const preempt_histogram &latency, u64 cpu, u64 wall,
+	u64 wakeups)
+{
+	printf("%-18s %6zu  latency (usecs)", name, n);
+	print_latency_usecs(latency);
+	print_cpu_usage(cpu, wall, n, "timer");
+	printf(", %llu wakeups\n", (unsigned long long)wakeups);
+}
+
+struct wheel_state {
+	preempt_histogram latency;
+	size_t nr_left;
+	bool done;
+};
+
+static void
+on_expire(timer_wheel::timer &t, u64)
+{
+	wheel_state &s = *(wheel_state *)t.data;
+
+	s.latency.record(time_unit::NOW(false).get_nanosecs() - t.expires_ns());
+	if (!--s.nr_left)
+		s.done = true;
+}
+
+static void
+bench_wheel(const char *name, size_t n, u64 window_ns, u64 tick_ns)
+{
+	timer_wheel wheel(time_unit::NANOSECS(tick_ns));
+	wheel_state s;
+	s.nr_left = n;
+	s.done = false;
+
+	vector<timer_wheel::timer> timers(n, timer_wheel::timer(on_expire, &s));
+
+	u64 wall = time_unit::NOW(false).get_nanosecs();
+	u64 cpu = process_cpu_ns();
+
+	vector<u64> d = deadlines(n, window_ns);
+	for (size_t i=0; i<n; ++i)
+		wheel.add(timers[i], d[i]);
+
+	u64 wakeups = 0;
+	while (!s.done) {
+		wheel.run_once();
+		wakeups++;
+	}
+
+	cpu = process_cpu_ns() - cpu;
+	wall = time_unit::NOW(false).get_nanosecs() - wall;
+
+	report(name, n, s.latency, cpu, wall, wakeups);
+}
+
+static void
+bench_threads(size_t n, u64 window_ns)
+{
+	vector<u64> latency(n);
+	vector<thread> threads;
+	threads.reserve(n);
+
+	u64 wall = time_unit::NOW(false).get_nanosecs();
+	u64 cpu = process_cpu_ns();
+
+	vector<u64> d = deadlines(n, window_ns);
+	for (size_t i=0; i<n; ++i) {
+		threads.emplace_back([&latency, &d, i]() {
+			time_unit t(false);
+			t.set_nanosecs(d[i]);
+			t.sleep_absolute();
+			latency[i] = time_unit::NOW(false).get_nanosecs() - d[i];
+		});
+	}
+
+	for (auto &t : threads)
+		t.join();
+
+	cpu = process_cpu_ns() - cpu;
+	wall = time_unit::NOW(false).get_nanosecs() - wall;
+
+	preempt_histogram h;
+	for (u64 l : latency)
+		h.record(l);
+
+	report("thread per sleep", n, h, cpu, wall, n);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nr_timers = argc > 1 ? (size_t)strtoull(argv[1], NULL, 0) : 100000;
+	u64 window_ns = (argc > 2 ? strtoull(argv[2], NULL, 0) : 1000) * 1000 * 1000;
+	u64 tick_ns = (argc > 3 ? strtoull(argv[3], NULL, 0) : 10) * 1000;
+	size_t nr_threads = argc > 4 ? (size_t)strtoull(argv[4], NULL, 0) : 1000;
+
+	if (!nr_timers || !window_ns || !tick_ns || !nr_threads) {
+		cout << "usage: " << argv[0] << " [timers] [window msecs] [tick usecs] [threads]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "deadlines spread over " << window_ns / 1000000 << " msecs, wheel tick "
+		<< tick_ns / 1000 << " usecs" << endl;
+
+	bench_wheel("timer_wheel", nr_timers, window_ns, tick_ns);
+	bench_wheel("timer_wheel", nr_threads, window_ns, tick_ns);
+	bench_threads(nr_threads, window_ns);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <iostream>
+using namespace std;
+
+#include "gcc_helpers/debug.h"
+
+#include "timer_wheel.h"
+
+static const u64 no_tick = ~(u64)0;
+
+// delta (ticks) that still fits in the top level
+static const u64 max_delta = ((u64)1 << (timer_wheel::level_bits * timer_wheel::nr_levels)) - 1;
+
+static inline u64
+rotr(u64 val, u32 n)
+{
+	n &= 63;
+	return n ? (val >> n) | (val << (64 - n)) : val;
+}
+
+void
+timer_wheel::list_init(timer &head)
+{
+	head._next = &head;
+	head._prev = &head;
+}
+
+timer_wheel::timer_wheel(time_unit tick)
+	: _tick_ns(tick.get_nanosecs()), _nr_timers(0), _in_advance(false),
+	_armed_tick(no_tick)
+{
+	if (!_tick_ns) {
+		cout << "timer_wheel: tick must not be 0, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	for (u32 l=0; l<nr_levels; ++l) {
+		for (u32 s=0; s<nr_slots; ++s)
+			list_init(_slots[l][s]);
+		_bitmap[l] = 0;
+	}
+
+	_now_tick = time_unit::NOW(false).get_nanosecs() / _tick_ns;
+
+	_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (_timer_fd < 0 || _epoll_fd < 0) {
+		cout << "unable to create timerfd/epoll, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	CHECK(epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _timer_fd, &ev));
+}
+
+timer_wheel::~timer_wheel()
+{
+	// leave no dangling pointers in the caller's timers
+	for (u32 l=0; l<nr_levels; ++l) {
+		for (u32 s=0; s<nr_slots; ++s) {
+			timer &head = _slots[l][s];
+			while (head._next != &head)
+				unlink(*head._next);
+		}
+	}
+
+	::close(_epoll_fd);
+	::close(_timer_fd);
+}
+
+void
+timer_wheel::place(timer &t)
+{
+	// already expired: the next tick processed
+	u64 tick = t._tick > _now_tick ? t._tick : _now_tick;
+	u64 delta = tick - _now_tick;
+
+	if (delta > max_delta) {
+		// re-placed by its real tick once cascaded
+		delta = max_delta;
+		tick = _now_tick + delta;
+	}
+
+	u32 level = delta ? (63 - (u32)__builtin_clzll(delta)) / level_bits : 0;
+	u32 slot = (u32)(tick >> (level * level_bits)) & (nr_slots - 1);
+
+	timer &head = _slots[level][slot];
+	t._next = &head;
+	t._prev = head._prev;
+	head._prev->_next = &t;
+	head._prev = &t;
+
+	t._level = level;
+	t._slot = slot;
+	_bitmap[level] |= (u64)1 << slot;
+}
+
+void
+timer_wheel::unlink(timer &t)
+{
+	t._prev->_next = t._next;
+	t._next->_prev = t._prev;
+
+	timer &head = _slots[t._level][t._slot];
+	if (head._next == &head)
+		_bitmap[t._level] &= ~((u64)1 << t._slot);
+
+	t._next = nullptr;
+	t._prev = nullptr;
+}
+
+void
+timer_wheel::add(timer &t, u64 expires_ns)
+{
+	if (t.pending())
+		unlink(t);
+	else
+		_nr_timers++;
+
+	t._expires_ns = expires_ns;
+	t._tick = (expires_ns + _tick_ns - 1) / _tick_ns;
+	place(t);
+
+	if (!_in_advance && t._tick < _armed_tick)
+		rearm();
+}
+
+void
+timer_wheel::add(timer &t, time_unit expires)
+{
+	add(t, expires.get_monotonic_nanosecs());
+}
+
+void
+timer_wheel::cancel(timer &t)
+{
+	if (!t.pending())
+		return;
+
+	unlink(t);
+	_nr_timers--;
+
+	// a timerfd armed too early only costs a spurious wakeup
+}
+
+void
+timer_wheel::cascade(u32 level, u32 slot)
+{
+	timer &head = _slots[level][slot];
+
+	while (head._next != &head) {
+		timer &t = *head._next;
+		unlink(t);
+		place(t);
+	}
+}
+
+/**
+ * Level 0: the first non-empty slot from the current tick on is an expiry.
+ * Level l > 0: slot s is cascaded at the first tick at or after _now_tick
+ * that is a multiple of 64^l and whose level l index is s.
+ */
+u64
+timer_wheel::next_event_tick() const
+{
+	u64 next = no_tick;
+
+	if (_bitmap[0]) {
+		u32 idx = (u32)_now_tick & (nr_slots - 1);
+		next = _now_tick + (u64)__builtin_ctzll(rotr(_bitmap[0], idx));
+	}
+
+	for (u32 l=1; l<nr_levels; ++l) {
+		if (!_bitmap[l])
+			continue;
+
+		u32 shift = l * level_bits;
+		u64 k0 = (_now_tick + ((u64)1 << shift) - 1) >> shift;
+		u32 idx = (u32)k0 & (nr_slots - 1);
+		u64 tick = (k0 + (u64)__builtin_ctzll(rotr(_bitmap[l], idx))) << shift;
+
+		if (tick < next)
+			next = tick;
+	}
+
+	return next;
+}
+
+u64
+timer_wheel::next_event_ns() const
+{
+	u64 tick = next_event_tick();
+
+	return tick == no_tick ? no_tick : tick * _tick_ns;
+}
+
+void
+timer_wheel::rearm()
+{
+	u64 tick = next_event_tick();
+	if (tick == _armed_tick)
+		return;
+
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+
+	// it_value 0 disarms
+	if (tick != no_tick) {
+		its.it_value = time_unit::nsec2ts(tick * _tick_ns);
+		if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+			its.it_value.tv_nsec = 1;
+	}
+
+	CHECK(timerfd_settime(_timer_fd, TFD_TIMER_ABSTIME, &its, NULL));
+	_armed_tick = tick;
+}
+
+size_t
+timer_wheel::advance(u64 now_ns)
+{
+	const u64 target = now_ns / _tick_ns;
+	size_t nr_expired = 0;
+
+	_in_advance = true;
+
+	for (;;) {
+		u64 tick = next_event_tick();
+		if (tick > target)
+			break;
+
+		_now_tick = tick;
+
+		// lowest level first (as the kernel did), see place()
+		for (u32 l=1; l<nr_levels; ++l) {
+			u32 shift = l * level_bits;
+			if (tick & (((u64)1 << shift) - 1))
+				break;
+			cascade(l, (u32)(tick >> shift) & (nr_slots - 1));
+		}
+
+		// timers added by the callbacks for this tick or earlier go to the next
+		_now_tick = tick + 1;
+
+		// taken off the slot first: a callback may add a timer 64 ticks
+		// ahead, i.e., to this very slot
+		u32 slot = (u32)tick & (nr_slots - 1);
+		timer &head = _slots[0][slot];
+		timer expired;
+		list_init(expired);
+		if (head._next != &head) {
+			expired._next = head._next;
+			expired._prev = head._prev;
+			expired._next->_prev = &expired;
+			expired._prev->_next = &expired;
+			list_init(head);
+			_bitmap[0] &= ~((u64)1 << slot);
+		}
+
+		while (expired._next != &expired) {
+			timer &t = *expired._next;
+			unlink(t);
+			_nr_timers--;
+			nr_expired++;
+
+			if (t.fn)
+				t.fn(t, now_ns);
+		}
+	}
+
+	// nothing happens in the ticks skipped
+	if (_now_tick <= target)
+		_now_tick = target + 1;
+
+	_in_advance = false;
+	rearm();
+
+	return nr_expired;
+}
+
+size_t
+timer_wheel::run_once(int timeout_ms)
+{
+	struct epoll_event ev;
+
+	int rtn = epoll_wait(_epoll_fd, &ev, 1, timeout_ms);
+	if (rtn < 0 && errno != EINTR) {
+		cout << "epoll_wait() failed, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+	if (rtn <= 0)
+		return 0;
+
+	// clears the expiration (nonblocking, may have been consumed already)
+	u64 expirations;
+	if (read(_timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+		cout << "timerfd read failed, exiting." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// the armed expiry was consumed, rearm() must set it again
+	_armed_tick = no_tick;
+
+	return advance(time_unit::NOW(false).get_nanosecs());
+}
+
+void
+timer_wheel::run(const volatile bool &stop)
+{
+	while (!stop)
+		run_once();
+}
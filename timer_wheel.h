@@ -0,0 +1,124 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Many timers on one thread: a hierarchical timer wheel (as in the linux
+ * kernel before 4.8, see REF) driven by one timerfd, armed for the next
+ * expiry, in an epoll loop.
+ *
+ * Time is divided into ticks of tick_ns, timers expire at the start of the
+ * first tick at or after their expiry (never early), and all timers of a
+ * tick are dispatched together: the tick is the batching granularity (a
+ * longer tick, fewer wakeups, later dispatch).
+ *
+ * The wheel has nr_levels levels of 64 slots.  Level l holds the timers that
+ * expire in 64^l to 64^(l+1) ticks, in the slot of their expiry's level l
+ * index; when the wheel reaches a slot of level l > 0, its timers are
+ * cascaded to the lower levels.  So adding and cancelling a timer are O(1)
+ * (a list insert/remove and a bitmap update), and finding the next expiry is
+ * O(nr_levels).  Ticks where nothing happens are skipped.
+ *
+ * Timers are owned by the caller (intrusive list nodes), the wheel allocates
+ * nothing.  A timer's callback may add or cancel any timer, itself included.
+ *
+ * A timer_wheel is used by one thread (e.g., the one calling run()).  Times
+ * are CLOCK_MONOTONIC nsecs (or timespec time_units).
+ *
+ * REF:
+ * G. Varghese and T. Lauck, "Hashed and Hierarchical Timing Wheels: Data
+ * Structures for the Efficient Implementation of a Timer Facility" (1987).
+ */
+
+#include <stddef.h>
+
+#include "data_types.h"
+#include "time_unit.h"
+
+class timer_wheel {
+	public:
+		static constexpr u32 level_bits = 6;
+		static constexpr u32 nr_slots = 1 << level_bits;
+		static constexpr u32 nr_levels = 8;
+		static constexpr u64 default_tick_ns = 10000;
+
+		struct timer {
+			typedef void (*callback_t)(timer &t, u64 now_ns);
+
+			callback_t fn;
+			void *data;  // for the callback
+
+			explicit timer(callback_t f=nullptr, void *d=nullptr)
+				: fn(f), data(d), _expires_ns(0), _tick(0), _next(nullptr),
+				_prev(nullptr), _level(0), _slot(0) {}
+
+			bool pending(void) const { return _next != nullptr; }
+			u64 expires_ns(void) const { return _expires_ns; }
+
+		private:
+			friend class timer_wheel;
+
+			u64 _expires_ns;
+			u64 _tick;
+			timer *_next;
+			timer *_prev;
+			u32 _level;
+			u32 _slot;
+		};
+
+		// exits on failure (epoll/timerfd)
+		explicit timer_wheel(time_unit tick=time_unit::NANOSECS(default_tick_ns));
+		~timer_wheel();
+
+		timer_wheel(const timer_wheel &) = delete;
+		timer_wheel &operator=(const timer_wheel &) = delete;
+
+		// (re)arms @t, O(1)
+		void add(timer &t, u64 expires_ns);
+		void add(timer &t, time_unit expires);
+		void cancel(timer &t);
+
+		size_t size(void) const { return _nr_timers; }
+		u64 tick_ns(void) const { return _tick_ns; }
+
+		/*
+		 * Waits up to @timeout_ms (-1: forever) for the next expiry and
+		 * dispatches the expired timers.  @return - number dispatched
+		 */
+		size_t run_once(int timeout_ms=-1);
+
+		// until @stop is set (checked after every wakeup, e.g., by a callback)
+		void run(const volatile bool &stop);
+
+		// dispatches the timers expired at @now_ns, without waiting
+		size_t advance(u64 now_ns);
+
+		// for adding the wheel to another epoll loop (readable: call run_once(0))
+		int fd(void) const { return _epoll_fd; }
+
+		// next tick something happens (an expiry or a cascade), U64 max if none
+		u64 next_event_ns(void) const;
+
+	private:
+		void place(timer &t);
+		void unlink(timer &t);
+		void cascade(u32 level, u32 slot);
+		u64 next_event_tick(void) const;
+		void rearm(void);
+
+		static void list_init(timer &head);
+
+		const u64 _tick_ns;
+
+		// sentinel of every slot's list, and which slots are non-empty
+		timer _slots[nr_levels][nr_slots];
+		u64 _bitmap[nr_levels];
+
+		u64 _now_tick;  // next tick to process
+		size_t _nr_timers;
+		bool _in_advance;
+
+		int _epoll_fd;
+		int _timer_fd;
+		u64 _armed_tick;
+};
@@ -0,0 +1,215 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+#include "time_unit.h"
+#include "timer_wheel.h"
+
+/**
+ * DESCRIPTION:
+ * Deterministic test of timer_wheel's levels and cascades: drives advance()
+ * with synthetic times (no sleeping, no timerfd expiry), from small steps up
+ * to jumps of 2^50 ticks, and checks against a model of the pending timers
+ * that after every advance(now)
+ *
+ * 	- no timer fired before its expiry
+ * 	- every timer whose expiry tick passed fired, exactly once
+ * 	- no cancelled timer fired
+ *
+ * The timers expire on every level of the wheel and past its range
+ * (max_delta, re-placed as they cascade).  Their callbacks re-add
+ * themselves, cancel and re-add other timers, and timers are also added
+ * between two advance()s, i.e., while the wheel's current tick is stale
+ * (the time passed since the last advance(), up to a long idle gap).
+ *
+ * usage: timer_wheel_test [timers (default 2000)] [steps (default 5000)] [seed (default 1)]
+ */
+
+static const u64 tick_ns = 10;
+
+struct test_timer {
+	timer_wheel::timer t;
+	size_t id;
+	bool pending;      // according to the model
+	u64 expires_ns;
+	u64 due_tick;      // the tick it must have fired by
+	u64 nr_fired;
+};
+
+struct test_state {
+	timer_wheel *wheel;
+	vector<test_timer> timers;
+	mt19937_64 rng;
+	u64 nr_errors;
+	u64 nr_fired;
+	u64 now_tick;      // of the advance() running, or last run
+	bool draining;     // no more adds
+};
+
+static test_state s;
+
+static u64
+expiry_tick(u64 expires_ns)
+{
+	return (expires_ns + tick_ns - 1) / tick_ns;
+}
+
+// a delta on a random level of the wheel, or past its range
+static u64
+random_delta_ns(void)
+{
+	u32 bits = (u32)(s.rng() % 53);  // ticks of up to 2^52 (max_delta is 2^48 - 1)
+	u64 ticks = bits ? ((u64)1 << (bits - 1)) + s.rng() % ((u64)1 << (bits - 1)) : 0;
+
+	return ticks * tick_ns + s.rng() % tick_ns;
+}
+
+static void
+add(test_timer &tt, u64 expires_ns)
+{
+	s.wheel->add(tt.t, expires_ns);
+	tt.pending = true;
+	tt.expires_ns = expires_ns;
+	// one already expired is put at the next tick, even from a callback
+	tt.due_tick = expiry_tick(expires_ns);
+	if (tt.due_tick <= s.now_tick)
+		tt.due_tick = s.now_tick + 1;
+}
+
+static void
+error(const test_timer &tt, const char *what, u64 now_ns)
+{
+	if (s.nr_errors++ < 10)
+		printf("timer %zu %s: expires %llu now %llu\n", tt.id, what,
+			(unsigned long long)tt.expires_ns, (unsigned long long)now_ns);
+}
+
+static void
+on_expire(timer_wheel::timer &t, u64 now_ns)
+{
+	test_timer &tt = *(test_timer *)t.data;
+
+	if (!tt.pending)
+		error(tt, "fired while not pending (cancelled or twice)", now_ns);
+	else if (now_ns < tt.expires_ns)
+		error(tt, "fired early", now_ns);
+
+	tt.pending = false;
+	tt.nr_fired++;
+	s.nr_fired++;
+
+	if (s.draining)
+		return;
+
+	switch (s.rng() % 4) {
+	case 0:
+		// periodic: re-add itself (possibly on another level)
+		add(tt, now_ns + random_delta_ns());
+		break;
+	case 1: {
+		// cancel another timer, maybe re-add it
+		test_timer &other = s.timers[s.rng() % s.timers.size()];
+		if (&other == &tt)
+			break;
+		s.wheel->cancel(other.t);
+		other.pending = false;
+		if (s.rng() % 2)
+			add(other, now_ns + random_delta_ns());
+		break;
+	}
+	case 2:
+		// already expired: must fire at the next tick processed, not now
+		add(tt, now_ns - (s.rng() % 1000));
+		break;
+	default:
+		break;
+	}
+}
+
+// every pending timer whose tick passed at @now_ns must have fired
+static void
+check_late(u64 now_ns)
+{
+	for (auto &tt : s.timers) {
+		if (tt.pending && tt.due_tick <= now_ns / tick_ns)
+			error(tt, "did not fire", now_ns);
+		if (tt.pending != tt.t.pending())
+			error(tt, "pending state differs from the wheel's", now_ns);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nr_timers = argc > 1 ? (size_t)strtoull(argv[1], NULL, 0) : 2000;
+	u64 nr_steps = argc > 2 ? strtoull(argv[2], NULL, 0) : 5000;
+	u64 seed = argc > 3 ? strtoull(argv[3], NULL, 0) : 1;
+
+	if (!nr_timers || !nr_steps) {
+		cout << "usage: " << argv[0] << " [timers] [steps] [seed]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	timer_wheel wheel(time_unit::NANOSECS(tick_ns));
+	s.wheel = &wheel;
+	s.rng.seed(seed);
+	s.timers.resize(nr_timers);
+
+	// the wheel starts at the current time
+	u64 now_ns = time_unit::NOW(false).get_nanosecs();
+	s.now_tick = now_ns / tick_ns;
+
+	for (size_t i=0; i<nr_timers; ++i) {
+		test_timer &tt = s.timers[i];
+		tt.t = timer_wheel::timer(on_expire, &tt);
+		tt.id = i;
+		tt.pending = false;
+		tt.nr_fired = 0;
+		add(tt, now_ns + random_delta_ns());
+	}
+
+	for (u64 step=0; step<nr_steps; ++step) {
+		// mostly short steps, sometimes a long idle gap (rarely, so that
+		// the synthetic time stays far from wrapping)
+		u32 bits = s.rng() % 64 ? (u32)(s.rng() % 20) : (u32)(s.rng() % 51);
+		now_ns += (s.rng() % ((u64)1 << bits)) * tick_ns + s.rng() % tick_ns;
+
+		// added while the wheel has not seen the time pass yet
+		for (int i=0; i<2; ++i) {
+			test_timer &tt = s.timers[s.rng() % nr_timers];
+			add(tt, now_ns + (s.rng() % 2 ? random_delta_ns() : s.rng() % (64 * tick_ns)));
+		}
+		if (s.rng() % 4 == 0) {
+			test_timer &tt = s.timers[s.rng() % nr_timers];
+			wheel.cancel(tt.t);
+			tt.pending = false;
+		}
+
+		s.now_tick = now_ns / tick_ns;
+		wheel.advance(now_ns);
+		check_late(now_ns);
+	}
+
+	// and everything left, however far
+	s.draining = true;
+	while (wheel.size()) {
+		u64 next = wheel.next_event_ns();
+		now_ns = next > now_ns ? next : now_ns + tick_ns;
+		s.now_tick = now_ns / tick_ns;
+		wheel.advance(now_ns);
+		check_late(now_ns);
+	}
+
+	u64 nr_pending = 0;
+	for (const auto &tt : s.timers)
+		nr_pending += tt.pending;
+
+	printf("%zu timers, %llu steps: %llu fired, %llu still pending, %llu errors\n",
+		nr_timers, (unsigned long long)nr_steps, (unsigned long long)s.nr_fired,
+		(unsigned long long)nr_pending, (unsigned long long)s.nr_errors);
+
+	return s.nr_errors || nr_pending ? EXIT_FAILURE : EXIT_SUCCESS;
+}
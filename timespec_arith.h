@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Arithmetic on struct timespec, as used by time_unit.
+ *
+ * A normalized timespec has 0 <= tv_nsec < 1E9.  tv_sec may be negative,
+ * which represents a negative length of time (e.g., -1.5 sec is
+ * tv_sec = -2, tv_nsec = 5E8).
+ *
+ * Adding or subtracting two normalized timespecs carries/borrows at most one
+ * second.  That common case is handled with compares (no branches, no
+ * division); only values further out of range take the division path.
+ */
+
+#include <time.h>
+
+#include "data_types.h"
+
+constexpr s64 NSEC_PER_SEC = (s64)1E9;
+
+static inline bool
+is_normalized(const struct timespec *ts)
+{
+	return ts->tv_nsec >= 0 && ts->tv_nsec < NSEC_PER_SEC;
+}
+
+/**
+ * Put sec and nsec into a normalized timespec.
+ *
+ * Overwrites existing values in ts.
+ */
+static inline void
+set_normalized_timespec(struct timespec *ts, s64 sec, s64 nsec)
+{
+	if (__builtin_expect(nsec > -NSEC_PER_SEC && nsec < 2 * NSEC_PER_SEC, 1)) {
+		// carry is -1, 0 or 1
+		s64 carry = (s64)(nsec >= NSEC_PER_SEC) - (s64)(nsec < 0);
+		sec += carry;
+		nsec -= carry * NSEC_PER_SEC;
+	} else {
+		s64 carry = nsec / NSEC_PER_SEC;
+		nsec -= carry * NSEC_PER_SEC;
+		// division truncates towards 0, so a negative remainder needs one
+		// more second borrowed
+		s64 borrow = (s64)(nsec < 0);
+		sec += carry - borrow;
+		nsec += borrow * NSEC_PER_SEC;
+	}
+
+	// TODO: check for overflow of tv_sec
+	ts->tv_sec = (time_t)sec;
+	ts->tv_nsec = (long)nsec;
+}
+
+static inline void
+set_timespec_nsecs(struct timespec *ts, u64 nsecs)
+{
+	ts->tv_sec = (time_t)(nsecs / (u64)NSEC_PER_SEC);
+	ts->tv_nsec = (long)(nsecs % (u64)NSEC_PER_SEC);
+}
+
+/**
+ * @rtn = @a + @b (all normalized)
+ */
+static inline void
+timespec_add(struct timespec *rtn, const struct timespec &a, const struct timespec &b)
+{
+	set_normalized_timespec(rtn, (s64)a.tv_sec + b.tv_sec, (s64)a.tv_nsec + b.tv_nsec);
+}
+
+/**
+ * @rtn = @a - @b (all normalized)
+ */
+static inline void
+timespec_sub(struct timespec *rtn, const struct timespec &a, const struct timespec &b)
+{
+	set_normalized_timespec(rtn, (s64)a.tv_sec - b.tv_sec, (s64)a.tv_nsec - b.tv_nsec);
+}
+
+/**
+ * timespec_add_ns - Adds nanoseconds to a timespec
+ * @a:      pointer to timespec to be incremented
+ * @ns:     unsigned nanoseconds value to be added
+ *
+ * from Linux kernel include/linux/time.h (division only if @ns >= 1 sec)
+ */
+static inline void
+timespec_add_ns(struct timespec *a, u64 ns)
+{
+	if (__builtin_expect(ns < (u64)NSEC_PER_SEC, 1)) {
+		set_normalized_timespec(a, a->tv_sec, (s64)a->tv_nsec + (s64)ns);
+	} else {
+		struct timespec b;
+		set_timespec_nsecs(&b, ns);
+		timespec_add(a, *a, b);
+	}
+}
+
+/**
+ * Adds @ns (which may be negative) to @a
+ */
+static inline void
+timespec_add_signed_ns(struct timespec *a, s64 ns)
+{
+	// the remainder is less than 1 sec, so normalizing takes the fast path
+	set_normalized_timespec(a, (s64)a->tv_sec + ns / NSEC_PER_SEC,
+			(s64)a->tv_nsec + ns % NSEC_PER_SEC);
+}
+
+/**
+ * <0, 0, >0 if @a is less, equal or greater than @b (both normalized)
+ */
+static inline int
+timespec_compare(const struct timespec &a, const struct timespec &b)
+{
+	if (a.tv_sec != b.tv_sec)
+		return a.tv_sec < b.tv_sec ? -1 : 1;
+
+	if (a.tv_nsec != b.tv_nsec)
+		return a.tv_nsec < b.tv_nsec ? -1 : 1;
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include <cstdlib> // EXIT_SUCCESS
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "x86_tsc.h"
+#include "time_unit.h"
+#include "tsc_skew.h"
+
+/**
+ * DESCRIPTION:
+ * Overhead and variance of the read_tsc() variants (see x86_tsc.h).
+ *
+ * Each sample is the number of cycles between two back-to-back reads, i.e.,
+ * the cost of measuring an empty region.  The begin/end row pairs
+ * read_tsc<tsc_read::begin>() with read_tsc<tsc_read::end>() as done by
+ * time_period::start()/stop().
+ *
+ * Afterwards the TSC offsets of all cpus are probed (see tsc_skew.h).
+ *
+ * usage: tsc_bench [nr_samples]
+ */
+
+static void report(const char *name, vector<u64> &deltas)
+{
+	double sum = 0, sum_sq = 0;
+
+	for (auto d : deltas) {
+		sum += (double)d;
+		sum_sq += (double)d * (double)d;
+	}
+
+	double n = (double)deltas.size();
+	double mean = sum / n;
+	double stddev = sqrt(max(0.0, sum_sq / n - mean * mean));
+
+	sort(deltas.begin(), deltas.end());
+
+	printf("%-12s min: %5llu  p50: %5llu  p99: %6llu  mean: %8.2f  stddev: %8.2f (cycles)\n",
+			name,
+			(unsigned long long)deltas.front(),
+			(unsigned long long)deltas[deltas.size() / 2],
+			(unsigned long long)deltas[deltas.size() * 99 / 100],
+			mean, stddev);
+}
+
+template <tsc_read BEGIN, tsc_read END>
+static void bench(const char *name, size_t nr_samples)
+{
+	vector<u64> deltas(nr_samples);
+
+	for (size_t i=0; i<nr_samples; ++i) {
+		u64 start = read_tsc<BEGIN>();
+		u64 stop = read_tsc<END>();
+		deltas[i] = stop - start;
+	}
+
+	report(name, deltas);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nr_samples = (size_t)1E6;
+
+	if (argc > 1)
+		nr_samples = strtoul(argv[1], NULL, 10);
+
+	u32 aux;
+	read_tsc<tsc_read::rdtscp>(&aux);
+	printf("running on cpu %u\n", tsc_aux_cpu(aux));
+
+	// warm up (e.g., frequency scaling of the core)
+	bench<tsc_read::plain, tsc_read::plain>("warmup", nr_samples);
+
+	bench<tsc_read::plain, tsc_read::plain>("plain", nr_samples);
+	bench<tsc_read::lfence, tsc_read::lfence>("lfence", nr_samples);
+	bench<tsc_read::rdtscp, tsc_read::rdtscp>("rdtscp", nr_samples);
+	bench<tsc_read::begin, tsc_read::end>("begin/end", nr_samples);
+
+	printf("--- tsc offsets relative to the first cpu ---\n");
+	bool synced = tsc_skew::probe(tsc_skew::default_threshold, true);
+	printf("max skew: %llu (+/- %llu) cycles, %s\n",
+			(unsigned long long)tsc_skew::max_skew(),
+			(unsigned long long)tsc_skew::max_error(),
+			synced ? "ok" : "exceeds threshold");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#include <time.h>
+#include <math.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "x86_tsc.h"
+#include "gcc_helpers/debug.h"
+
+#include "time_unit.h"
+#include "tsc_calibration.h"
+
+// typical tolerance of the crystal the cpuid ratio is based on
+constexpr double cpuid_crystal_ppm = 100;
+
+// samples taken during measure(), one every sample_period_ns
+constexpr u64 sample_period_ns = (u64)1E6;
+
+const char *
+tsc_calibration::source_str() const
+{
+	switch (source) {
+		case SRC_CPUID:    return "cpuid";
+		case SRC_KERNEL:   return "kernel";
+		case SRC_MEASURED: return "measured";
+		default:           return "none";
+	}
+}
+
+/**
+ * REF:
+ * Intel SDM vol. 2A, CPUID leaf 15H (Time Stamp Counter and Nominal Core
+ * Crystal Clock Information) and leaf 16H (Processor Frequency Information).
+ * linux kernel arch/x86/kernel/tsc.c (native_calibrate_tsc()).
+ */
+tsc_calibration
+tsc_calibration::from_cpuid()
+{
+	tsc_calibration rtn;
+
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned eax, ebx, ecx, edx;
+	unsigned max_leaf = __get_cpuid_max(0, NULL);
+
+	if (max_leaf < 0x15)
+		return rtn;
+
+	// eax: denominator, ebx: numerator of the TSC/crystal ratio
+	// ecx: crystal frequency (Hz), may be 0 if not enumerated
+	__cpuid_count(0x15, 0, eax, ebx, ecx, edx);
+	if (0 == eax || 0 == ebx)
+		return rtn;
+
+	if (0 != ecx) {
+		rtn.hz = (double)ecx * (double)ebx / (double)eax;
+		rtn.error_ppm = cpuid_crystal_ppm;
+		rtn.source = SRC_CPUID;
+		return rtn;
+	}
+
+	// no crystal frequency, fall back to the base frequency (MHz) of leaf 0x16
+	if (max_leaf < 0x16)
+		return rtn;
+
+	__cpuid_count(0x16, 0, eax, ebx, ecx, edx);
+	if (0 == eax)
+		return rtn;
+
+	rtn.hz = (double)eax * 1E6;
+	// only MHz resolution
+	rtn.error_ppm = 0.5E6 / (double)eax;
+	rtn.source = SRC_CPUID;
+#endif
+
+	return rtn;
+}
+
+/**
+ * Some kernels export the frequency they calibrated the TSC to (tsc_khz).
+ */
+tsc_calibration
+tsc_calibration::from_kernel()
+{
+	tsc_calibration rtn;
+	ifstream istm("/sys/devices/system/cpu/cpu0/tsc_freq_khz");
+	u64 khz = 0;
+
+	if (!(istm >> khz) || 0 == khz)
+		return rtn;
+
+	rtn.hz = (double)khz * 1E3;
+	// only kHz resolution
+	rtn.error_ppm = 0.5E6 / (double)khz;
+	rtn.source = SRC_KERNEL;
+
+	return rtn;
+}
+
+/**
+ * Read the TSC and CLOCK_MONOTONIC_RAW as close together as possible.
+ *
+ * The pair with the shortest TSC window around clock_gettime() out of a few
+ * tries is used, with the TSC taken at the middle of the window.
+ */
+static void
+sample_clocks(u64 &tsc, u64 &nsecs)
+{
+	u64 best_window = ~0ULL;
+
+	for (int i=0; i<4; ++i) {
+		struct timespec ts;
+		u64 before = read_tsc();
+		CHECK(clock_gettime(CLOCK_MONOTONIC_RAW, &ts));
+		u64 after = read_tsc();
+
+		if (after - before < best_window) {
+			best_window = after - before;
+			tsc = before + best_window / 2;
+			nsecs = (u64)ts.tv_sec * (u64)1E9 + (u64)ts.tv_nsec;
+		}
+	}
+}
+
+/**
+ * Least squares fit of TSC cycles against CLOCK_MONOTONIC_RAW nsecs, sampled
+ * every sample_period_ns for @msecs.  error_ppm is the standard error of the
+ * fitted slope.
+ */
+tsc_calibration
+tsc_calibration::measure(u64 msecs)
+{
+	tsc_calibration rtn;
+	vector<double> xs, ys; // nsecs, cycles (relative to the first sample)
+	u64 tsc0, ns0, tsc, ns;
+
+	sample_clocks(tsc0, ns0);
+	xs.push_back(0);
+	ys.push_back(0);
+
+	do {
+		time_unit::nanosleep(sample_period_ns);
+		sample_clocks(tsc, ns);
+		xs.push_back((double)(ns - ns0));
+		ys.push_back((double)(tsc - tsc0));
+	} while (ns - ns0 < msecs * (u64)1E6);
+
+	const size_t n = xs.size();
+	if (n < 3)
+		return rtn;
+
+	double x_mean = 0, y_mean = 0;
+	for (size_t i=0; i<n; ++i) {
+		x_mean += xs[i];
+		y_mean += ys[i];
+	}
+	x_mean /= (double)n;
+	y_mean /= (double)n;
+
+	double sxx = 0, sxy = 0;
+	for (size_t i=0; i<n; ++i) {
+		sxx += (xs[i] - x_mean) * (xs[i] - x_mean);
+		sxy += (xs[i] - x_mean) * (ys[i] - y_mean);
+	}
+	double slope = sxy / sxx; // cycles per nsec
+
+	double ssr = 0;
+	for (size_t i=0; i<n; ++i) {
+		double res = ys[i] - (y_mean + slope * (xs[i] - x_mean));
+		ssr += res * res;
+	}
+	double slope_err = sqrt(ssr / (double)(n - 2) / sxx);
+
+	rtn.hz = slope * 1E9;
+	rtn.error_ppm = slope_err / slope * 1E6;
+	rtn.source = SRC_MEASURED;
+
+	return rtn;
+}
+
+tsc_calibration
+tsc_calibration::calibrate()
+{
+	tsc_calibration rtn = from_cpuid();
+
+	if (!rtn.valid())
+		rtn = from_kernel();
+
+	if (!rtn.valid())
+		rtn = measure();
+
+	return rtn;
+}
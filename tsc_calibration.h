@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Determines the TSC frequency without the multi-second sleep (and network
+ * access) needed by time_unit::init_hz().  The sources are tried in order:
+ *
+ * 	- CPUID leaf 0x15 (TSC/crystal ratio), or leaf 0x16 (base frequency)
+ * 	- the kernel's tsc_khz (if exported through sysfs)
+ * 	- a short multi-sample regression against CLOCK_MONOTONIC_RAW
+ *
+ * Every result carries an estimate of its relative error, so the caller can
+ * decide whether it is good enough (e.g., for a long running measurement,
+ * time_unit::init_hz() or the cpu_hz executable are still more accurate).
+ */
+
+#include "data_types.h"
+
+class tsc_calibration {
+	public:
+		enum source_t {
+			SRC_NONE,
+			SRC_CPUID,
+			SRC_KERNEL,
+			SRC_MEASURED,
+		};
+
+		double hz;
+		double error_ppm; // estimated relative error of hz
+		source_t source;
+
+		tsc_calibration(void) : hz(0), error_ppm(0), source(SRC_NONE) {}
+
+		bool valid(void) const { return SRC_NONE != source; }
+		const char *source_str(void) const;
+
+		static tsc_calibration from_cpuid(void);
+		static tsc_calibration from_kernel(void);
+		static tsc_calibration measure(u64 msecs=50);
+
+		// first valid result of the sources above
+		static tsc_calibration calibrate(void);
+};
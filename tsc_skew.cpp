@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+#include "tsc_skew.h"
+#include "cpu_affinity.h"
+
+// round trips per pair of cpus, the shortest one is used
+constexpr int nr_rounds = 1000;
+
+bool tsc_skew::_probed = false;
+bool tsc_skew::_active = false;
+u64 tsc_skew::_max_error = 0;
+u64 tsc_skew::_max_skew = 0;
+s64 tsc_skew::_offsets[tsc_skew::max_cpus];
+
+/**
+ * The cache line passed between the two cpus.
+ *
+ * turn is odd while cpu_b should answer, even once it did (and stored its TSC
+ * in tsc).
+ */
+struct alignas(64) ping_pong {
+	atomic<u64> turn;
+	atomic<u64> tsc;
+};
+
+bool
+tsc_skew::measure_pair(int cpu_a, int cpu_b, s64 &offset, u64 &error)
+{
+	ping_pong line;
+	line.turn = 0;
+	line.tsc = 0;
+
+	atomic<bool> b_pinned(false);
+	atomic<bool> b_failed(false);
+	atomic<bool> quit(false);
+
+	thread responder([&]() {
+		if (!pin_to_cpu(cpu_b)) {
+			b_failed = true;
+			return;
+		}
+		b_pinned = true;
+
+		for (u64 i=0; i<nr_rounds; ++i) {
+			while (line.turn.load(memory_order_acquire) != 2*i + 1)
+				if (quit.load(memory_order_relaxed))
+					return;
+			line.tsc.store(read_tsc<tsc_read::lfence>(), memory_order_relaxed);
+			line.turn.store(2*i + 2, memory_order_release);
+		}
+	});
+
+	cpu_set_t old_set;
+	pthread_getaffinity_np(pthread_self(), sizeof(old_set), &old_set);
+
+	bool ok = pin_to_cpu(cpu_a);
+	while (ok && !b_pinned && !b_failed)
+		;
+	ok = ok && !b_failed;
+
+	u64 best_rtt = ~0ULL;
+	for (u64 i=0; ok && i<nr_rounds; ++i) {
+		u64 start = read_tsc<tsc_read::lfence>();
+		line.turn.store(2*i + 1, memory_order_release);
+		while (line.turn.load(memory_order_acquire) != 2*i + 2)
+			;
+		u64 stop = read_tsc<tsc_read::lfence>();
+		u64 tsc_b = line.tsc.load(memory_order_relaxed);
+
+		// cpu_b read its TSC somewhere between start and stop, assume the
+		// middle
+		if (stop - start < best_rtt) {
+			best_rtt = stop - start;
+			offset = (s64)(tsc_b - (start + best_rtt / 2));
+		}
+	}
+
+	if (!ok)
+		quit = true;
+
+	responder.join();
+	pthread_setaffinity_np(pthread_self(), sizeof(old_set), &old_set);
+
+	error = best_rtt / 2;
+
+	return ok;
+}
+
+/**
+ * Every pair of cpus is measured (n * (n - 1) / 2 pairs, a fraction of a msec
+ * each).  With d(i, j) the measured offset of cpu j relative to cpu i, the
+ * least squares fit of offsets o to all pairs (d(i, j) = o(j) - o(i)) is
+ *
+ * 	o(k) = 1/n * sum over j of d(j, k)
+ *
+ * shifted so that the first cpu's offset is 0.
+ */
+bool
+tsc_skew::probe(u64 threshold, bool verbose)
+{
+	cpu_set_t allowed;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		cout << "sched_getaffinity() failed, unable to probe tsc skew." << endl;
+		return false;
+	}
+
+	vector<int> cpus;
+	for (int cpu=0; cpu<CPU_SETSIZE && cpu<(int)max_cpus; ++cpu) {
+		if (CPU_ISSET(cpu, &allowed))
+			cpus.push_back(cpu);
+	}
+
+	const size_t n = cpus.size();
+	vector<s64> d(n * n, 0);  // d[i * n + j]: offset of cpus[j] relative to cpus[i]
+	u64 max_err = 0;
+	u64 max_pair_skew = 0;
+	size_t worst_a = 0, worst_b = 0;
+
+	for (size_t i=0; i<n; ++i) {
+		for (size_t j=i+1; j<n; ++j) {
+			s64 off;
+			u64 err;
+			if (!measure_pair(cpus[i], cpus[j], off, err)) {
+				cout << "unable to measure tsc offset between cpus " << cpus[i]
+					<< " and " << cpus[j] << endl;
+				return false;
+			}
+
+			d[i * n + j] = off;
+			d[j * n + i] = -off;
+			if (err > max_err)
+				max_err = err;
+
+			u64 skew = (u64)(off < 0 ? -off : off);
+			if (skew > max_pair_skew) {
+				max_pair_skew = skew;
+				worst_a = i;
+				worst_b = j;
+			}
+		}
+	}
+
+	for (u32 cpu=0; cpu<max_cpus; ++cpu)
+		_offsets[cpu] = 0;
+
+	vector<s64> fit(n, 0);
+	for (size_t k=0; k<n; ++k) {
+		s64 sum = 0;
+		for (size_t j=0; j<n; ++j)
+			sum += d[j * n + k];
+		fit[k] = sum / (s64)n;
+	}
+	for (size_t k=0; k<n; ++k) {
+		_offsets[cpus[k]] = fit[k] - fit[0];
+
+		if (verbose)
+			printf("cpu %4d: offset %8lld (+/- %llu) cycles\n", cpus[k],
+				(long long)_offsets[cpus[k]], (unsigned long long)max_err);
+	}
+
+	if (verbose && n > 1)
+		printf("largest skew %llu cycles, between cpus %d and %d\n",
+			(unsigned long long)max_pair_skew, cpus[worst_a], cpus[worst_b]);
+
+	_max_error = max_err;
+	_max_skew = max_pair_skew;
+	_probed = true;
+	_active = true;
+
+	// offsets within the uncertainty of the measurement are noise, don't
+	// "correct" synchronized TSCs with them
+	if (_max_skew <= 2 * max_err) {
+		for (u32 cpu=0; cpu<max_cpus; ++cpu)
+			_offsets[cpu] = 0;
+		_active = false;
+	}
+
+	if (_max_skew > threshold + 2 * max_err) {
+		cout << "WARNING: tsc skew between cpus of " << _max_skew << " cycles (threshold "
+			<< threshold << "), correcting readings with the measured offsets." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool
+tsc_skew::probed()
+{
+	return _probed;
+}
+
+bool
+tsc_skew::active()
+{
+	return _active;
+}
+
+s64
+tsc_skew::offset(u32 cpu)
+{
+	return _offsets[cpu % max_cpus];
+}
+
+u64
+tsc_skew::max_error()
+{
+	return _max_error;
+}
+
+u64
+tsc_skew::max_skew()
+{
+	return _max_skew;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+ * DESCRIPTION:
+ *
+ * Per-cpu TSC offsets.
+ *
+ * Even with an invariant TSC, the TSCs of different cpus (e.g., sockets) may
+ * not be synchronized.  A thread that migrates between two TSC reads then
+ * measures the skew between the cpus as well.
+ *
+ * probe() measures the offset between every pair of cpus this process may
+ * run on, using two pinned threads passing a cache line back and forth, and
+ * fits one offset per cpu (relative to the first one) to all the pairs, so
+ * the offset between any two cpus does not depend on a third one's
+ * measurement alone.  The skew reported is the largest one measured between
+ * two cpus directly.  The cpu id returned by rdtscp is then used by correct()
+ * to remove the offset from a reading.  Before probe() is called all offsets
+ * are 0, so correct() is a no-op.
+ *
+ * Once probe() found skew (see active()), every time_unit cycles reading is
+ * corrected (see read()).  read_tsc() itself always returns the raw TSC, its
+ * values may only be compared with other raw readings of the same cpu (e.g.,
+ * by a thread pinned to it, as cpu_consumer's trial_loop()).
+ *
+ * NOTE: probe() must be called before any other threads use correct(), the
+ * offset table is not protected against concurrent updates.
+ */
+
+#include "data_types.h"
+#include "x86_tsc.h"
+
+class tsc_skew {
+	public:
+		// largest cpu id that fits in IA32_TSC_AUX (see tsc_aux_cpu())
+		static constexpr u32 max_cpus = 4096;
+
+		// the cpu of a reading is not known (see read())
+		static constexpr u32 no_cpu = ~0U;
+
+		// default for flagging a host as having (uncorrected) skew
+		static constexpr u64 default_threshold = 1000; // cycles
+
+		/**
+		 * @return - true if no offset exceeded @threshold (i.e., TSCs can be
+		 * compared across cpus even without correction)
+		 */
+		static bool probe(u64 threshold=default_threshold, bool verbose=false);
+
+		static bool probed(void);
+
+		// true if probe() found skew, i.e., readings are being corrected
+		static bool active(void);
+
+		// offset (cycles) of @cpu relative to the reference cpu
+		static s64 offset(u32 cpu);
+
+		// largest uncertainty of the measured offsets (cycles)
+		static u64 max_error(void);
+
+		// largest difference between offsets (cycles)
+		static u64 max_skew(void);
+
+		// @tsc/@aux as returned by rdtscp
+		static u64 correct(u64 tsc, u32 aux);
+
+		/**
+		 * The TSC, corrected if active() (@cpu is then the cpu it was read
+		 * on), otherwise a plain read_tsc() (@cpu is no_cpu).
+		 */
+		static u64 read(u32 &cpu);
+
+		/**
+		 * Offset of @cpu_b's TSC relative to @cpu_a's, @error is the
+		 * uncertainty of the measurement (half of the shortest round trip).
+		 */
+		static bool measure_pair(int cpu_a, int cpu_b, s64 &offset, u64 &error);
+
+	private:
+		tsc_skew();
+
+		static bool _probed;
+		static bool _active;
+		static u64 _max_error;
+		static u64 _max_skew;
+		static s64 _offsets[max_cpus];
+};
+
+/**
+ * inline functions (must be put in header)
+ * https://isocpp.org/wiki/faq/inline-functions
+ */
+
+inline
+u64 tsc_skew::correct(u64 tsc, u32 aux)
+{
+	return tsc - (u64)_offsets[tsc_aux_cpu(aux)];
+}
+
+inline
+u64 tsc_skew::read(u32 &cpu)
+{
+	if (!_active) {
+		cpu = no_cpu;
+		return read_tsc();
+	}
+
+	u32 aux = 0;
+	u64 tsc = read_tsc<tsc_read::rdtscp>(&aux);
+	cpu = tsc_aux_cpu(aux);
+
+	return tsc - (u64)_offsets[cpu];
+}
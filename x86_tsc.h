@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 // ----- (start) from linux kernel v2.6.29/arch/x86/include/asm/msr.h
 /*
  * both i386 and x86_64 returns 64-bit value in edx:eax, but gcc's "A"
@@ -36,3 +39,89 @@ static inline uint64_t read_tsc()
 #endif
 }
 // ----- (end) from linux kernel v2.6.29/arch/x86/include/asm/msr.h
+
+// spin-wait hint (pause), frees resources for the sibling hyperthread
+static inline void cpu_relax(void)
+{
+#ifndef ANDROID
+	asm volatile("pause" ::: "memory");
+#endif
+}
+
+/*
+ * Serializing variants of read_tsc(), selected at compile time:
+ *
+ * 	read_tsc<tsc_read::plain>()  - same as read_tsc(), may be reordered with
+ * 	                               the surrounding instructions
+ * 	read_tsc<tsc_read::lfence>() - waits for all prior instructions to
+ * 	                               complete before reading
+ * 	read_tsc<tsc_read::rdtscp>() - rdtscp, waits for prior instructions and
+ * 	                               returns IA32_TSC_AUX (see tsc_aux_cpu())
+ * 	read_tsc<tsc_read::begin>()  - start of a measured region, neither prior
+ * 	                               nor following instructions cross the read
+ * 	read_tsc<tsc_read::end>()    - end of a measured region, prior
+ * 	                               instructions complete before the read and
+ * 	                               following ones do not start before it
+ *
+ * The rdtscp, begin and end variants also return IA32_TSC_AUX in @aux (see
+ * tsc_read_has_aux()), which allows per-cpu corrections (see tsc_skew.h).
+ *
+ * REF:
+ * Intel, "How to Benchmark Code Execution Times on Intel IA-32 and IA-64
+ * Instruction Set Architectures" (begin/end pairing), and the Intel SDM
+ * descriptions of RDTSC/RDTSCP (lfence instead of cpuid for serialization,
+ * since cpuid traps to the hypervisor in a virtual machine).
+ */
+enum class tsc_read {
+	plain,
+	lfence,
+	rdtscp,
+	begin,
+	end,
+};
+
+constexpr bool tsc_read_has_aux(tsc_read r)
+{
+	return r == tsc_read::rdtscp || r == tsc_read::begin || r == tsc_read::end;
+}
+
+// linux sets IA32_TSC_AUX to (numa node << 12) | cpu
+static inline uint32_t tsc_aux_cpu(uint32_t aux)
+{
+	return aux & 0xfff;
+}
+
+template <tsc_read R>
+static inline uint64_t read_tsc(uint32_t *aux = NULL)
+{
+#ifndef ANDROID
+	DECLARE_ARGS(val, low, high);
+	uint32_t tsc_aux = 0;
+
+	switch (R) {
+		case tsc_read::plain:
+			asm volatile("rdtsc" : EAX_EDX_RET(val, low, high));
+			break;
+		case tsc_read::lfence:
+			asm volatile("lfence; rdtsc" : EAX_EDX_RET(val, low, high) :: "memory");
+			break;
+		case tsc_read::rdtscp:
+			asm volatile("rdtscp" : EAX_EDX_RET(val, low, high), "=c" (tsc_aux) :: "memory");
+			break;
+		case tsc_read::begin:
+			asm volatile("lfence; rdtscp; lfence" : EAX_EDX_RET(val, low, high), "=c" (tsc_aux) :: "memory");
+			break;
+		case tsc_read::end:
+			asm volatile("rdtscp; lfence" : EAX_EDX_RET(val, low, high), "=c" (tsc_aux) :: "memory");
+			break;
+	}
+
+	if (aux)
+		*aux = tsc_aux;
+
+	return EAX_EDX_VAL(val, low, high);
+#else
+	(void)aux;
+	return read_tsc();
+#endif
+}